@@ -330,6 +330,18 @@ livi_application_startup (GApplication *g_application)
   gtk_application_set_accels_for_action (GTK_APPLICATION (self),
 					 "win.ff(-10000)",
                                          (const char *[]){ "Left", NULL });
+  gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+					 "win.trick-mode(+1)",
+                                         (const char *[]){ "bracketright", NULL });
+  gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+					 "win.trick-mode(-1)",
+                                         (const char *[]){ "bracketleft", NULL });
+  gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+					 "win.step(+1)",
+                                         (const char *[]){ "period", NULL });
+  gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+					 "win.step(-1)",
+                                         (const char *[]){ "comma", NULL });
   gtk_application_set_accels_for_action (GTK_APPLICATION (self),
 					 "win.toggle-controls",
                                          (const char *[]){ "Escape", NULL });
@@ -339,6 +351,9 @@ livi_application_startup (GApplication *g_application)
   gtk_application_set_accels_for_action (GTK_APPLICATION (self),
 					 "win.open-file",
                                          (const char *[]){"<ctrl>o", NULL, });
+  gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+					 "win.snapshot",
+                                         (const char *[]){"s", NULL, });
   gtk_application_set_accels_for_action (GTK_APPLICATION (self),
                                          "window.close",
                                          (const char *[]){ "q", NULL });
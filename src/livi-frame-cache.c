@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2024 Guido Günther <agx@sigxcpu.org>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Author: Guido Günther <agx@sigxcpu.org>
+ */
+
+#define G_LOG_DOMAIN "livi-frame-cache"
+
+#include "livi-config.h"
+
+#include "livi-frame-cache.h"
+
+/**
+ * LiviFrameCache:
+ *
+ * Keeps recently shown frames around so stepping back through them
+ * doesn't need to decode them again. Frames are referenced as they
+ * were decoded, without copying them, so each one holds on to one of
+ * the decoder's buffers. Each frame remembers the frame decoded right
+ * before it so only consecutive frames are returned. The number of
+ * frames and their estimated size are bounded, frames furthest away
+ * from the last added one are dropped first.
+ */
+
+typedef struct _LiviCachedFrame {
+  GdkTexture   *texture;
+  LiviGstFrame *frame;
+  GstClockTime  pts;
+  GstClockTime  prev_pts;
+  gsize         size;
+} LiviCachedFrame;
+
+
+struct _LiviFrameCache {
+  GObject               parent;
+
+  /* Sorted by pts */
+  GQueue                frames;
+  guint                 max_frames;
+  gsize                 max_bytes;
+  gsize                 bytes;
+};
+G_DEFINE_TYPE (LiviFrameCache, livi_frame_cache, G_TYPE_OBJECT)
+
+
+static void
+livi_cached_frame_free (LiviCachedFrame *frame)
+{
+  g_clear_object (&frame->texture);
+  g_clear_pointer (&frame->frame, livi_gst_frame_unref);
+
+  g_free (frame);
+}
+
+
+static LiviCachedFrame *
+livi_cached_frame_new (GdkTexture   *texture,
+                       LiviGstFrame *gst_frame,
+                       GstClockTime  pts,
+                       GstClockTime  prev_pts)
+{
+  LiviCachedFrame *frame;
+
+  frame = g_new0 (LiviCachedFrame, 1);
+  frame->texture = g_object_ref (texture);
+  frame->frame = gst_frame ? livi_gst_frame_ref (gst_frame) : NULL;
+  frame->pts = pts;
+  frame->prev_pts = prev_pts;
+  /* Assume 4 bytes per pixel, planar YUV needs less */
+  frame->size = (gsize) gdk_texture_get_width (texture) * gdk_texture_get_height (texture) * 4;
+
+  return frame;
+}
+
+
+static LiviCachedFrame *
+livi_frame_cache_find (LiviFrameCache *self, GstClockTime pts)
+{
+  for (GList *l = self->frames.head; l; l = l->next) {
+    LiviCachedFrame *frame = l->data;
+
+    if (frame->pts == pts)
+      return frame;
+    if (frame->pts > pts)
+      break;
+  }
+
+  return NULL;
+}
+
+
+static void
+livi_frame_cache_finalize (GObject *object)
+{
+  LiviFrameCache *self = LIVI_FRAME_CACHE (object);
+
+  livi_frame_cache_clear (self);
+
+  G_OBJECT_CLASS (livi_frame_cache_parent_class)->finalize (object);
+}
+
+
+static void
+livi_frame_cache_class_init (LiviFrameCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = livi_frame_cache_finalize;
+}
+
+
+static void
+livi_frame_cache_init (LiviFrameCache *self)
+{
+  g_queue_init (&self->frames);
+}
+
+
+LiviFrameCache *
+livi_frame_cache_new (guint max_frames, gsize max_bytes)
+{
+  LiviFrameCache *self = g_object_new (LIVI_TYPE_FRAME_CACHE, NULL);
+
+  self->max_frames = max_frames;
+  self->max_bytes = max_bytes;
+
+  return self;
+}
+
+/**
+ * livi_frame_cache_add:
+ * @self: The frame cache
+ * @texture: The frame's texture
+ * @gst_frame:(nullable): What keeps the texture's data alive
+ * @pts: The frame's presentation timestamp
+ * @prev_pts: The presentation timestamp of the frame decoded right
+ *   before or `GST_CLOCK_TIME_NONE` if not known (e.g. after a seek)
+ *
+ * Adds the frame to the cache, possibly dropping other frames to stay
+ * within the limits. The frame just added is always kept.
+ */
+void
+livi_frame_cache_add (LiviFrameCache *self,
+                      GdkTexture     *texture,
+                      LiviGstFrame   *gst_frame,
+                      GstClockTime    pts,
+                      GstClockTime    prev_pts)
+{
+  LiviCachedFrame *frame;
+  GList *l;
+
+  g_return_if_fail (LIVI_IS_FRAME_CACHE (self));
+  g_return_if_fail (GDK_IS_TEXTURE (texture));
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (pts));
+
+  for (l = self->frames.head; l; l = l->next) {
+    LiviCachedFrame *cached = l->data;
+
+    if (cached->pts == pts) {
+      if (GST_CLOCK_TIME_IS_VALID (prev_pts))
+        cached->prev_pts = prev_pts;
+      return;
+    }
+    if (cached->pts > pts)
+      break;
+  }
+
+  if (self->max_frames == 0)
+    return;
+
+  frame = livi_cached_frame_new (texture, gst_frame, pts, prev_pts);
+  if (l)
+    g_queue_insert_before (&self->frames, l, frame);
+  else
+    g_queue_push_tail (&self->frames, frame);
+  self->bytes += frame->size;
+
+  /* Drop the frames that are furthest away */
+  while (self->frames.length > self->max_frames ||
+         (self->bytes > self->max_bytes && self->frames.length > 1)) {
+    LiviCachedFrame *head = g_queue_peek_head (&self->frames);
+    LiviCachedFrame *tail = g_queue_peek_tail (&self->frames);
+    LiviCachedFrame *drop;
+
+    if (pts - head->pts > tail->pts - pts)
+      drop = g_queue_pop_head (&self->frames);
+    else
+      drop = g_queue_pop_tail (&self->frames);
+
+    self->bytes -= drop->size;
+    livi_cached_frame_free (drop);
+  }
+
+  g_debug ("Cached frame at %" GST_TIME_FORMAT ", %u frames, %" G_GSIZE_FORMAT " bytes",
+           GST_TIME_ARGS (pts), self->frames.length, self->bytes);
+}
+
+/**
+ * livi_frame_cache_get_previous:
+ * @self: The frame cache
+ * @pts: The presentation timestamp of a cached frame
+ * @prev_pts:(out): The previous frame's presentation timestamp
+ * @gst_frame:(out)(transfer none)(nullable): What keeps the texture's data alive
+ *
+ * Looks up the frame decoded right before the one at @pts.
+ *
+ * Returns:(transfer none)(nullable): The frame's texture
+ */
+GdkTexture *
+livi_frame_cache_get_previous (LiviFrameCache  *self,
+                               GstClockTime     pts,
+                               GstClockTime    *prev_pts,
+                               LiviGstFrame   **gst_frame)
+{
+  LiviCachedFrame *frame;
+
+  g_return_val_if_fail (LIVI_IS_FRAME_CACHE (self), NULL);
+
+  frame = livi_frame_cache_find (self, pts);
+  if (frame == NULL || !GST_CLOCK_TIME_IS_VALID (frame->prev_pts))
+    return NULL;
+
+  frame = livi_frame_cache_find (self, frame->prev_pts);
+  if (frame == NULL)
+    return NULL;
+
+  *prev_pts = frame->pts;
+  *gst_frame = frame->frame;
+  return frame->texture;
+}
+
+/**
+ * livi_frame_cache_get_next:
+ * @self: The frame cache
+ * @pts: The presentation timestamp of a cached frame
+ * @next_pts:(out): The next frame's presentation timestamp
+ * @gst_frame:(out)(transfer none)(nullable): What keeps the texture's data alive
+ *
+ * Looks up the frame decoded right after the one at @pts.
+ *
+ * Returns:(transfer none)(nullable): The frame's texture
+ */
+GdkTexture *
+livi_frame_cache_get_next (LiviFrameCache  *self,
+                           GstClockTime     pts,
+                           GstClockTime    *next_pts,
+                           LiviGstFrame   **gst_frame)
+{
+  g_return_val_if_fail (LIVI_IS_FRAME_CACHE (self), NULL);
+
+  for (GList *l = self->frames.head; l; l = l->next) {
+    LiviCachedFrame *frame = l->data;
+
+    if (frame->prev_pts == pts) {
+      *next_pts = frame->pts;
+      *gst_frame = frame->frame;
+      return frame->texture;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * livi_frame_cache_clear:
+ * @self: The frame cache
+ *
+ * Drops all frames.
+ */
+void
+livi_frame_cache_clear (LiviFrameCache *self)
+{
+  g_return_if_fail (LIVI_IS_FRAME_CACHE (self));
+
+  g_queue_clear_full (&self->frames, (GDestroyNotify) livi_cached_frame_free);
+  self->bytes = 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 Guido Günther <agx@sigxcpu.org>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include "livi-gst-paintable.h"
+
+#include <gdk/gdk.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define LIVI_TYPE_FRAME_CACHE (livi_frame_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (LiviFrameCache, livi_frame_cache, LIVI, FRAME_CACHE, GObject)
+
+LiviFrameCache *livi_frame_cache_new (guint           max_frames,
+                                      gsize           max_bytes);
+void            livi_frame_cache_add (LiviFrameCache *self,
+                                      GdkTexture     *texture,
+                                      LiviGstFrame   *frame,
+                                      GstClockTime    pts,
+                                      GstClockTime    prev_pts);
+GdkTexture     *livi_frame_cache_get_previous (LiviFrameCache  *self,
+                                               GstClockTime     pts,
+                                               GstClockTime    *prev_pts,
+                                               LiviGstFrame   **frame);
+GdkTexture     *livi_frame_cache_get_next (LiviFrameCache  *self,
+                                           GstClockTime     pts,
+                                           GstClockTime    *next_pts,
+                                           LiviGstFrame   **frame);
+void            livi_frame_cache_clear (LiviFrameCache *self);
+
+G_END_DECLS
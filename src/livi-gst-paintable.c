@@ -17,17 +17,112 @@
 
 #include <math.h>
 
+#define N_PRESENTED_FRAMES 4
+/* One in the mailbox, one being latched, one being filled */
+#define N_INVOCATIONS      4
+/* Released frames kept for reuse, covers the paintable and the step cache */
+#define N_SPARE_FRAMES     16
+
+typedef struct _SetTextureInvocation {
+  gint              in_use;
+  gboolean          from_heap;
+  GdkTexture       *texture;
+  double            pixel_aspect_ratio;
+  graphene_rect_t   viewport;
+  guint64           timestamp;
+  gint64            due_time;
+  GPtrArray        *overlays;
+  GDestroyNotify    frame_release;
+  gpointer          frame_data;
+} SetTextureInvocation;
+
+struct _LiviGstFrame {
+  guint             ref_count;
+  GDestroyNotify    release;
+  gpointer          data;
+};
+
+/* Frames are only handled on the main thread */
+static LiviGstFrame *spare_frames[N_SPARE_FRAMES];
+static guint n_spare_frames;
+static guint n_frame_allocs;
+
+/* A latched frame waiting for its presentation feedback */
+typedef struct _PresentedFrame {
+  gint64   frame_counter;
+  guint64  timestamp;
+  gint64   due_time;
+} PresentedFrame;
+
 struct _LiviGstPaintable {
   GObject       parent_instance;
 
   GdkPaintable *image;
   double        pixel_aspect_ratio;
   graphene_rect_t viewport;
+  GPtrArray    *overlays;
+
+  /* Applied when drawing so frames can stay untouched */
+  GstVideoOrientationMethod orientation;
+  graphene_rect_t           zoom;
 
   GdkGLContext *context;
+  /* Created ahead of the player so it can set up GL, see livi_gst_paintable_prepare_async () */
+  GstElement   *sink;
+
+  /* Single slot mailbox filled by the streaming thread */
+  gpointer      pending;
+  GSource      *wakeup_source;
+  guint         n_dropped;
+  SetTextureInvocation invocations[N_INVOCATIONS];
+  /* Invocations that didn't fit into the slots above */
+  guint         n_invocation_allocs;
+
+  /* Keeps the buffers of the current and the previous frame alive */
+  LiviGstFrame  *frames[2];
+
+  /* Frames are latched on the frame clock when realized */
+  GdkFrameClock *frame_clock;
+  PresentedFrame presented[N_PRESENTED_FRAMES];
+  guint          presented_idx;
+
+  gboolean       offloadable;
+
+  /* Scale frames to the on screen size before they reach GTK */
+  gboolean       downscale;
+  guint          held_frames;
+  gboolean       gl_scaler;
+  gboolean       sw_scaler;
+  GdkSurface    *surface;
+  int            target_width;
+  int            target_height;
+  int            pending_target_width;
+  int            pending_target_height;
+  guint          target_size_id;
+};
+
+enum {
+  PROP_0,
+  PROP_OFFLOADABLE,
+  PROP_DOWNSCALE,
+  PROP_HELD_FRAMES,
+  LAST_PROP
 };
+static GParamSpec *props[LAST_PROP];
+
+enum {
+  FRAME_PRESENTED,
+  TARGET_SIZE_CHANGED,
+  N_SIGNALS
+};
+static guint signals[N_SIGNALS] = { 0 };
 
 static void livi_gst_paintable_paintable_init (GdkPaintableInterface *iface);
+static void set_texture_invocation_free (SetTextureInvocation *invoke);
+static gboolean livi_gst_paintable_set_texture_invoke (gpointer data);
+static void livi_gst_paintable_set_frame_clock (LiviGstPaintable *self, GdkFrameClock *frame_clock);
+static void livi_gst_paintable_release_frame (LiviGstPaintable *self, guint idx);
+static LiviGstFrame *livi_gst_frame_new (GDestroyNotify release, gpointer data);
 static void livi_gst_paintable_video_renderer_init (GstPlayVideoRendererInterface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (LiviGstPaintable, livi_gst_paintable, G_TYPE_OBJECT,
@@ -36,15 +131,131 @@ G_DEFINE_TYPE_WITH_CODE (LiviGstPaintable, livi_gst_paintable, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (GST_TYPE_PLAY_VIDEO_RENDERER,
                                                 livi_gst_paintable_video_renderer_init));
 
+static gboolean
+livi_gst_paintable_is_zoomed (LiviGstPaintable *self)
+{
+  return !graphene_rect_equal (&self->zoom, &GRAPHENE_RECT_INIT (0, 0, 1, 1));
+}
+
+static gboolean
+viewport_covers_image (LiviGstPaintable *self)
+{
+  return G_APPROX_VALUE (self->viewport.origin.x, 0, FLT_EPSILON) &&
+    G_APPROX_VALUE (self->viewport.origin.y, 0, FLT_EPSILON) &&
+    G_APPROX_VALUE (self->viewport.size.width, gdk_paintable_get_intrinsic_width (self->image), FLT_EPSILON) &&
+    G_APPROX_VALUE (self->viewport.size.height, gdk_paintable_get_intrinsic_height (self->image), FLT_EPSILON);
+}
+
 static void
-livi_gst_paintable_paintable_snapshot (GdkPaintable *paintable,
-                                       GdkSnapshot  *snapshot,
-                                       double        width,
-                                       double        height)
+livi_gst_paintable_set_target_size (LiviGstPaintable *self,
+                                    int               width,
+                                    int               height)
 {
-  LiviGstPaintable *self = LIVI_GST_PAINTABLE (paintable);
+  if (self->target_width == width && self->target_height == height)
+    return;
 
-  if (self->image)
+  self->target_width = width;
+  self->target_height = height;
+  g_signal_emit (self, signals[TARGET_SIZE_CHANGED], 0, width, height);
+}
+
+/* Ignore small changes to not renegotiate on every pixel of a resize */
+#define TARGET_SIZE_SLACK 2
+/* Only renegotiate once a resize or zoom settled */
+#define TARGET_SIZE_SETTLE_MS 300
+
+static void
+on_target_size_settled (gpointer user_data)
+{
+  LiviGstPaintable *self = LIVI_GST_PAINTABLE (user_data);
+
+  self->target_size_id = 0;
+  livi_gst_paintable_set_target_size (self,
+                                      self->pending_target_width,
+                                      self->pending_target_height);
+}
+
+/*
+ * Only records the size the frame is drawn at as this happens while
+ * painting. Upstream is asked for the new size once it stopped changing.
+ */
+static void
+livi_gst_paintable_update_target_size (LiviGstPaintable *self,
+                                       double            width,
+                                       double            height)
+{
+  double scale;
+  int w, h;
+
+  if (!((self->sw_scaler || self->gl_scaler) && self->downscale))
+    return;
+
+  if (self->surface == NULL)
+    return;
+
+  /* The size in device pixels so fractional scales are taken into account */
+  scale = gdk_surface_get_scale (self->surface);
+  w = ceil (width * scale);
+  h = ceil (height * scale);
+
+  if (w == self->pending_target_width && h == self->pending_target_height)
+    return;
+
+  self->pending_target_width = w;
+  self->pending_target_height = h;
+  g_clear_handle_id (&self->target_size_id, g_source_remove);
+
+  if (ABS (w - self->target_width) <= TARGET_SIZE_SLACK &&
+      ABS (h - self->target_height) <= TARGET_SIZE_SLACK)
+    return;
+
+  self->target_size_id = g_timeout_add_once (TARGET_SIZE_SETTLE_MS, on_target_size_settled, self);
+  g_source_set_name_by_id (self->target_size_id, "[livi] target size");
+}
+
+/*
+ * Overlays are drawn as textures of their own on top of the video so
+ * the video frame itself doesn't need to be touched.
+ */
+static void
+livi_gst_paintable_snapshot_overlays (LiviGstPaintable *self,
+                                      GdkSnapshot      *snapshot,
+                                      double            width,
+                                      double            height)
+{
+  double sx, sy;
+
+  if (self->overlays == NULL)
+    return;
+
+  sx = width / self->viewport.size.width;
+  sy = height / self->viewport.size.height;
+
+  for (guint i = 0; i < self->overlays->len; i++) {
+    LiviGstOverlay *overlay = g_ptr_array_index (self->overlays, i);
+
+    gtk_snapshot_append_texture (snapshot, overlay->texture,
+                                 &GRAPHENE_RECT_INIT (overlay->bounds.origin.x * sx,
+                                                      overlay->bounds.origin.y * sy,
+                                                      overlay->bounds.size.width * sx,
+                                                      overlay->bounds.size.height * sy));
+  }
+}
+
+/* Draws the visible part of the frame and its overlays */
+static void
+livi_gst_paintable_snapshot_image (LiviGstPaintable *self,
+                                   GdkSnapshot      *snapshot,
+                                   double            width,
+                                   double            height)
+{
+  if (viewport_covers_image (self))
+    {
+      /* A plain texture node can be offloaded to a subsurface */
+      gdk_paintable_snapshot (self->image, snapshot, width, height);
+      livi_gst_paintable_snapshot_overlays (self, snapshot, width, height);
+    }
+  else
     {
       float sx, sy;
 
@@ -59,12 +270,111 @@ livi_gst_paintable_paintable_snapshot (GdkPaintable *paintable,
                                                               -self->viewport.origin.y * height / self->viewport.size.height));
 
       gdk_paintable_snapshot (self->image, snapshot, width * sx, height * sy);
+      livi_gst_paintable_snapshot_overlays (self, snapshot, width, height);
 
       gtk_snapshot_pop (snapshot);
       gtk_snapshot_restore (snapshot);
     }
 }
 
+static gboolean
+orientation_swaps_axes (GstVideoOrientationMethod orientation)
+{
+  switch (orientation) {
+  case GST_VIDEO_ORIENTATION_90R:
+  case GST_VIDEO_ORIENTATION_90L:
+  case GST_VIDEO_ORIENTATION_UL_LR:
+  case GST_VIDEO_ORIENTATION_UR_LL:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+/*
+ * Maps the frame onto a @width x @height area so it shows up with the
+ * given orientation.
+ */
+static void
+snapshot_orient (GdkSnapshot               *snapshot,
+                 GstVideoOrientationMethod  orientation,
+                 double                     width,
+                 double                     height)
+{
+  switch (orientation) {
+  case GST_VIDEO_ORIENTATION_90R:
+    gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (width, 0));
+    gtk_snapshot_rotate (snapshot, 90);
+    break;
+  case GST_VIDEO_ORIENTATION_180:
+    gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (width, height));
+    gtk_snapshot_rotate (snapshot, 180);
+    break;
+  case GST_VIDEO_ORIENTATION_90L:
+    gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, height));
+    gtk_snapshot_rotate (snapshot, 270);
+    break;
+  case GST_VIDEO_ORIENTATION_HORIZ:
+    gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (width, 0));
+    gtk_snapshot_scale (snapshot, -1, 1);
+    break;
+  case GST_VIDEO_ORIENTATION_VERT:
+    gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, height));
+    gtk_snapshot_scale (snapshot, 1, -1);
+    break;
+  case GST_VIDEO_ORIENTATION_UL_LR:
+    gtk_snapshot_rotate (snapshot, 90);
+    gtk_snapshot_scale (snapshot, 1, -1);
+    break;
+  case GST_VIDEO_ORIENTATION_UR_LL:
+    gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (width, height));
+    gtk_snapshot_rotate (snapshot, 90);
+    gtk_snapshot_scale (snapshot, -1, 1);
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+livi_gst_paintable_paintable_snapshot (GdkPaintable *paintable,
+                                       GdkSnapshot  *snapshot,
+                                       double        width,
+                                       double        height)
+{
+  LiviGstPaintable *self = LIVI_GST_PAINTABLE (paintable);
+  gboolean swap = orientation_swaps_axes (self->orientation);
+  double frame_width = swap ? height : width;
+  double frame_height = swap ? width : height;
+
+  /* Zooming in shows more of the frame's details */
+  livi_gst_paintable_update_target_size (self,
+                                         frame_width / self->zoom.size.width,
+                                         frame_height / self->zoom.size.height);
+
+  if (self->image == NULL)
+    return;
+
+  if (self->orientation == GST_VIDEO_ORIENTATION_IDENTITY && !livi_gst_paintable_is_zoomed (self)) {
+    livi_gst_paintable_snapshot_image (self, snapshot, width, height);
+    return;
+  }
+
+  /* Transform the untouched frame instead of flipping or cropping it upstream */
+  gtk_snapshot_save (snapshot);
+  gtk_snapshot_push_clip (snapshot, &GRAPHENE_RECT_INIT (0, 0, width, height));
+
+  gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (-self->zoom.origin.x * width / self->zoom.size.width,
+                                                          -self->zoom.origin.y * height / self->zoom.size.height));
+  gtk_snapshot_scale (snapshot, 1.0 / self->zoom.size.width, 1.0 / self->zoom.size.height);
+
+  snapshot_orient (snapshot, self->orientation, width, height);
+  livi_gst_paintable_snapshot_image (self, snapshot, frame_width, frame_height);
+
+  gtk_snapshot_pop (snapshot);
+  gtk_snapshot_restore (snapshot);
+}
+
 static GdkPaintable *
 livi_gst_paintable_paintable_get_current_image (GdkPaintable *paintable)
 {
@@ -81,6 +391,9 @@ livi_gst_paintable_paintable_get_intrinsic_width (GdkPaintable *paintable)
 {
   LiviGstPaintable *self = LIVI_GST_PAINTABLE (paintable);
 
+  if (self->image && orientation_swaps_axes (self->orientation))
+    return ceil (self->viewport.size.height);
+
   if (self->image)
     return round (self->pixel_aspect_ratio * self->viewport.size.width);
 
@@ -92,6 +405,9 @@ livi_gst_paintable_paintable_get_intrinsic_height (GdkPaintable *paintable)
 {
   LiviGstPaintable *self = LIVI_GST_PAINTABLE (paintable);
 
+  if (self->image && orientation_swaps_axes (self->orientation))
+    return round (self->pixel_aspect_ratio * self->viewport.size.width);
+
   if (self->image)
     return ceil (self->viewport.size.height);
 
@@ -103,6 +419,9 @@ livi_gst_paintable_paintable_get_intrinsic_aspect_ratio (GdkPaintable *paintable
 {
   LiviGstPaintable *self = LIVI_GST_PAINTABLE (paintable);
 
+  if (self->image && orientation_swaps_axes (self->orientation))
+    return self->viewport.size.height / self->viewport.size.width;
+
   if (self->image)
     return self->viewport.size.width / self->viewport.size.height;
 
@@ -119,25 +438,204 @@ livi_gst_paintable_paintable_init (GdkPaintableInterface *iface)
   iface->get_intrinsic_aspect_ratio = livi_gst_paintable_paintable_get_intrinsic_aspect_ratio;
 }
 
+/* Puts @filter in front of @sink */
+static GstElement *
+livi_gst_paintable_wrap_sink (GstElement *filter, GstElement *sink)
+{
+  GstElement *bin = gst_bin_new (NULL);
+  g_autoptr (GstPad) pad = NULL;
+
+  gst_bin_add_many (GST_BIN (bin), filter, sink, NULL);
+  gst_element_link (filter, sink);
+
+  pad = gst_element_get_static_pad (filter, "sink");
+  gst_element_add_pad (bin, gst_ghost_pad_new ("sink", pad));
+
+  return bin;
+}
+
+/* Roughly the number of pixels one thread converts in time at 60fps */
+#define PIXELS_PER_THREAD (640 * 360)
+
+/*
+ * Pick the number of conversion threads based on the frame size so
+ * small videos don't pay for the synchronization.
+ */
+static GstPadProbeReturn
+on_sw_scaler_caps (GstPad          *pad,
+                   GstPadProbeInfo *info,
+                   gpointer         user_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  GstVideoInfo v_info;
+  GstCaps *caps;
+  guint n_threads;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+    return GST_PAD_PROBE_OK;
+
+  gst_event_parse_caps (event, &caps);
+  if (!gst_video_info_from_caps (&v_info, caps))
+    return GST_PAD_PROBE_OK;
+
+  n_threads = (GST_VIDEO_INFO_WIDTH (&v_info) * GST_VIDEO_INFO_HEIGHT (&v_info)) / PIXELS_PER_THREAD;
+  n_threads = CLAMP (n_threads, 1, g_get_num_processors ());
+
+  g_debug ("Converting %dx%d with %u threads",
+           GST_VIDEO_INFO_WIDTH (&v_info), GST_VIDEO_INFO_HEIGHT (&v_info), n_threads);
+  g_object_set (GST_PAD_PARENT (pad), "n-threads", n_threads, NULL);
+
+  return GST_PAD_PROBE_OK;
+}
+
+#define DEINTERLACER_NAME "livi-deinterlacer"
+#define DEINTERLACED_NAME "livi-deinterlaced"
+
+/*
+ * gldeinterlace only negotiates GL memory, even in passthrough, so it's
+ * only linked in front of the sink while the stream is interlaced. That
+ * way dmabufs still reach the sink for progressive content. The caps
+ * event didn't pass the ghost pad yet so it ends up at the new target.
+ */
+static GstPadProbeReturn
+on_deinterlace_bin_caps (GstPad          *pad,
+                         GstPadProbeInfo *info,
+                         gpointer         user_data)
+{
+  GstBin *bin = GST_BIN (user_data);
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  g_autoptr (GstElement) deinterlacer = NULL;
+  g_autoptr (GstElement) sink = NULL;
+  g_autoptr (GstPad) target = NULL;
+  GstVideoInfo v_info;
+  GstCaps *caps;
+  gboolean interlaced;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+    return GST_PAD_PROBE_OK;
+
+  gst_event_parse_caps (event, &caps);
+  if (!gst_video_info_from_caps (&v_info, caps))
+    return GST_PAD_PROBE_OK;
+
+  interlaced = GST_VIDEO_INFO_IS_INTERLACED (&v_info);
+  deinterlacer = gst_bin_get_by_name (bin, DEINTERLACER_NAME);
+  if (interlaced == (deinterlacer != NULL))
+    return GST_PAD_PROBE_OK;
+
+  sink = gst_bin_get_by_name (bin, DEINTERLACED_NAME);
+
+  if (interlaced) {
+    deinterlacer = gst_element_factory_make ("gldeinterlace", DEINTERLACER_NAME);
+    if (deinterlacer == NULL) {
+      g_warning ("gldeinterlace not available, can't deinterlace");
+      return GST_PAD_PROBE_OK;
+    }
+
+    g_debug ("Linking GL deinterlacer");
+    gst_object_ref (deinterlacer);
+    gst_bin_add (bin, deinterlacer);
+    gst_element_link (deinterlacer, sink);
+    gst_element_sync_state_with_parent (deinterlacer);
+    target = gst_element_get_static_pad (deinterlacer, "sink");
+    gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
+  } else {
+    g_debug ("Unlinking GL deinterlacer");
+    target = gst_element_get_static_pad (sink, "sink");
+    gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
+    gst_element_set_state (deinterlacer, GST_STATE_NULL);
+    gst_bin_remove (bin, deinterlacer);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Puts a bin in front of @sink that deinterlaces on demand */
+static GstElement *
+livi_gst_paintable_wrap_deinterlacer (GstElement *sink)
+{
+  GstElement *bin = gst_bin_new (NULL);
+  g_autoptr (GstPad) pad = NULL;
+  GstPad *ghost;
+
+  gst_object_set_name (GST_OBJECT (sink), DEINTERLACED_NAME);
+  gst_bin_add (GST_BIN (bin), sink);
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  ghost = gst_ghost_pad_new ("sink", pad);
+  gst_pad_add_probe (ghost, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                     on_deinterlace_bin_caps, bin, NULL);
+  gst_element_add_pad (bin, ghost);
+
+  return bin;
+}
+
+static GstElement *
+livi_gst_paintable_new_sink (LiviGstPaintable *self)
+{
+  return g_object_new (LIVI_TYPE_GST_SINK,
+                       "paintable", self,
+                       "gl-context", self->context,
+                       NULL);
+}
+
 static GstElement *
 livi_gst_paintable_video_renderer_create_video_sink (GstPlayVideoRenderer *renderer,
                                                      GstPlay              *player)
 {
   LiviGstPaintable *self = LIVI_GST_PAINTABLE (renderer);
   GstElement *sink, *glsinkbin;
-  g_autoptr (GdkGLContext) ctx = NULL;
 
-  sink = g_object_new (LIVI_TYPE_GST_SINK,
-                       "paintable", self,
-                       "gl-context", self->context,
-                       NULL);
+  if (self->sink) {
+    sink = g_steal_pointer (&self->sink);
+    /* Hand our reference over to playbin */
+    g_object_force_floating (G_OBJECT (sink));
+  } else {
+    sink = livi_gst_paintable_new_sink (self);
+  }
+
+  /*
+   * Without GL the sink can still import dmabufs or use system memory. The
+   * chain can't be changed once playbin has it so wait for the GL context,
+   * this doesn't block if the paintable got prepared.
+   */
+  if (!livi_gst_sink_wait_gl (LIVI_GST_SINK (sink))) {
+    GstElement *scaler = NULL;
+
+    /* Otherwise frames reach the sink as decoded, which keeps dmabufs working */
+    if (self->downscale)
+      scaler = gst_element_factory_make ("videoconvertscale", NULL);
 
-  g_object_get (LIVI_GST_SINK (sink), "gl-context", &ctx, NULL);
+    if (scaler) {
+      g_autoptr (GstPad) pad = gst_element_get_static_pad (scaler, "sink");
+
+      gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                         on_sw_scaler_caps, NULL, NULL);
+      sink = livi_gst_paintable_wrap_sink (scaler, sink);
+      self->sw_scaler = TRUE;
+      g_debug ("scaling frames in software");
+    }
+
+    g_debug ("created sink without GL");
+    return sink;
+  }
 
-  /* GL rendering won't work otherwise */
-  g_assert (self->context != NULL && ctx != NULL);
   glsinkbin = gst_element_factory_make ("glsinkbin", NULL);
 
+  if (self->downscale) {
+    GstElement *scaler = gst_element_factory_make ("glcolorscale", NULL);
+
+    if (scaler) {
+      sink = livi_gst_paintable_wrap_sink (scaler, sink);
+      self->gl_scaler = TRUE;
+      g_debug ("scaling frames on the GPU");
+    } else {
+      g_warning ("glcolorscale not available, can't downscale");
+    }
+  }
+
+  sink = livi_gst_paintable_wrap_deinterlacer (sink);
+
   g_object_set (glsinkbin, "sink", sink, NULL);
 
   g_debug ("created gl sink");
@@ -155,22 +653,180 @@ livi_gst_paintable_dispose (GObject *object)
 {
   LiviGstPaintable *self = LIVI_GST_PAINTABLE (object);
 
+  if (self->wakeup_source) {
+    g_source_destroy (self->wakeup_source);
+    g_clear_pointer (&self->wakeup_source, g_source_unref);
+  }
+  livi_gst_paintable_set_frame_clock (self, NULL);
+  gst_clear_object (&self->sink);
+  g_clear_handle_id (&self->target_size_id, g_source_remove);
+  g_clear_weak_pointer (&self->surface);
+  g_clear_pointer (&self->pending, set_texture_invocation_free);
   g_clear_object (&self->image);
+  g_clear_pointer (&self->overlays, g_ptr_array_unref);
+  livi_gst_paintable_release_frame (self, 0);
+  livi_gst_paintable_release_frame (self, 1);
 
   G_OBJECT_CLASS (livi_gst_paintable_parent_class)->dispose (object);
 }
 
+static void
+livi_gst_paintable_get_property (GObject    *object,
+                                 guint       property_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  LiviGstPaintable *self = LIVI_GST_PAINTABLE (object);
+
+  switch (property_id) {
+  case PROP_OFFLOADABLE:
+    g_value_set_boolean (value, self->offloadable);
+    break;
+  case PROP_DOWNSCALE:
+    g_value_set_boolean (value, self->downscale);
+    break;
+  case PROP_HELD_FRAMES:
+    g_value_set_uint (value, self->held_frames);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+livi_gst_paintable_set_property (GObject      *object,
+                                 guint         property_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  LiviGstPaintable *self = LIVI_GST_PAINTABLE (object);
+
+  switch (property_id) {
+  case PROP_DOWNSCALE:
+    livi_gst_paintable_set_downscale (self, g_value_get_boolean (value));
+    break;
+  case PROP_HELD_FRAMES:
+    livi_gst_paintable_set_held_frames (self, g_value_get_uint (value));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
 static void
 livi_gst_paintable_class_init (LiviGstPaintableClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->get_property = livi_gst_paintable_get_property;
+  object_class->set_property = livi_gst_paintable_set_property;
   object_class->dispose = livi_gst_paintable_dispose;
+
+  /**
+   * LiviGstPaintable:offloadable:
+   *
+   * Whether the current frame can be offloaded to a subsurface by
+   * [class@Gtk.GraphicsOffload]. This is the case for dmabuf textures
+   * that aren't cropped.
+   */
+  props[PROP_OFFLOADABLE] =
+    g_param_spec_boolean ("offloadable", "", "",
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * LiviGstPaintable:downscale:
+   *
+   * Whether to scale frames down to the size they're shown at on the
+   * GPU before handing them to GTK. This needs to be set before the
+   * video sink is created to have an effect. Without GL frames are
+   * scaled in software instead.
+   */
+  props[PROP_DOWNSCALE] =
+    g_param_spec_boolean ("downscale", "", "",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * LiviGstPaintable:held-frames:
+   *
+   * How many frames are referenced outside of the paintable, e.g. to
+   * step back through them. The sink asks upstream for that many
+   * additional buffers so decoders with fixed pools don't run dry.
+   */
+  props[PROP_HELD_FRAMES] =
+    g_param_spec_uint ("held-frames", "", "",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, LAST_PROP, props);
+
+  /**
+   * LiviGstPaintable::frame-presented:
+   * @self: The paintable
+   * @timestamp: The timestamp the frame was queued with
+   * @lateness: How much later than expected the frame reached the
+   *   screen in nanoseconds, zero or negative if it was in time
+   *
+   * Emitted on the main thread once the frame clock reports when a
+   * frame was actually presented.
+   */
+  signals[FRAME_PRESENTED] = g_signal_new ("frame-presented",
+                                           G_TYPE_FROM_CLASS (klass),
+                                           G_SIGNAL_RUN_LAST,
+                                           0, NULL, NULL, NULL,
+                                           G_TYPE_NONE, 2,
+                                           G_TYPE_UINT64,
+                                           G_TYPE_INT64);
+
+  /**
+   * LiviGstPaintable::target-size-changed:
+   * @self: The paintable
+   * @width: The width in device pixels or 0 to not scale
+   * @height: The height in device pixels or 0 to not scale
+   *
+   * Emitted on the main thread when the size frames should be scaled
+   * to changes.
+   */
+  signals[TARGET_SIZE_CHANGED] = g_signal_new ("target-size-changed",
+                                               G_TYPE_FROM_CLASS (klass),
+                                               G_SIGNAL_RUN_LAST,
+                                               0, NULL, NULL, NULL,
+                                               G_TYPE_NONE, 2,
+                                               G_TYPE_INT,
+                                               G_TYPE_INT);
 }
 
+static gboolean
+wakeup_source_dispatch (GSource     *source,
+                        GSourceFunc  callback,
+                        gpointer     user_data)
+{
+  /* Rearm before looking at the mailbox so no frame can get lost */
+  g_source_set_ready_time (source, -1);
+
+  return callback (user_data);
+}
+
+static GSourceFuncs wakeup_source_funcs = {
+  .dispatch = wakeup_source_dispatch,
+};
+
 static void
 livi_gst_paintable_init (LiviGstPaintable *self)
 {
+  self->wakeup_source = g_source_new (&wakeup_source_funcs, sizeof (GSource));
+  g_source_set_callback (self->wakeup_source, livi_gst_paintable_set_texture_invoke, self, NULL);
+  g_source_set_name (self->wakeup_source, "[livi] set texture");
+  g_source_attach (self->wakeup_source, NULL);
+
+  for (guint i = 0; i < N_PRESENTED_FRAMES; i++)
+    self->presented[i].frame_counter = -1;
+
+  self->orientation = GST_VIDEO_ORIENTATION_IDENTITY;
+  self->zoom = GRAPHENE_RECT_INIT (0, 0, 1, 1);
 }
 
 GdkPaintable *
@@ -185,6 +841,9 @@ livi_gst_paintable_realize (LiviGstPaintable *self,
 {
   g_autoptr (GError) error = NULL;
 
+  livi_gst_paintable_set_frame_clock (self, gdk_surface_get_frame_clock (surface));
+  g_set_weak_pointer (&self->surface, surface);
+
   if (self->context)
     return;
 
@@ -201,6 +860,74 @@ livi_gst_paintable_realize (LiviGstPaintable *self,
   }
 }
 
+static void
+on_sink_gl_ready (GObject      *source_object,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+  g_autoptr (GTask) task = G_TASK (user_data);
+  GError *error = NULL;
+  gboolean have_gl;
+
+  have_gl = livi_gst_sink_wait_gl_finish (LIVI_GST_SINK (source_object), res, &error);
+  if (error) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  g_debug ("Sink prepared %s GL", have_gl ? "with" : "without");
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * livi_gst_paintable_prepare_async:
+ * @self: The paintable
+ * @cancellable:(nullable): A cancellable
+ * @callback: Called once the paintable is ready
+ * @user_data: The data passed to @callback
+ *
+ * Creates the video sink and waits for its GL setup to finish without
+ * blocking the main thread. Once done the paintable can be handed to
+ * a #GstPlay without holding up the main thread. Must be called after
+ * livi_gst_paintable_realize () so the GL context is known.
+ */
+void
+livi_gst_paintable_prepare_async (LiviGstPaintable    *self,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (LIVI_IS_GST_PAINTABLE (self));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, livi_gst_paintable_prepare_async);
+
+  if (self->sink == NULL)
+    self->sink = gst_object_ref_sink (livi_gst_paintable_new_sink (self));
+
+  livi_gst_sink_wait_gl_async (LIVI_GST_SINK (self->sink), cancellable, on_sink_gl_ready, task);
+}
+
+/**
+ * livi_gst_paintable_prepare_finish:
+ * @self: The paintable
+ * @res: The result
+ * @error: The return location for an error
+ *
+ * Returns: %TRUE if the paintable got prepared, %FALSE on error
+ */
+gboolean
+livi_gst_paintable_prepare_finish (LiviGstPaintable  *self,
+                                   GAsyncResult      *res,
+                                   GError           **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
 void
 livi_gst_paintable_unrealize (LiviGstPaintable *self,
                               GdkSurface       *surface)
@@ -209,6 +936,15 @@ livi_gst_paintable_unrealize (LiviGstPaintable *self,
    * - track how often we were realized with that surface
    * - track alternate surfaces
    */
+  if (self->frame_clock == gdk_surface_get_frame_clock (surface))
+    livi_gst_paintable_set_frame_clock (self, NULL);
+
+  if (self->surface == surface)
+    g_clear_weak_pointer (&self->surface);
+
+  /* The sink references us, don't keep it around if it never got used */
+  gst_clear_object (&self->sink);
+
   if (self->context == NULL)
     return;
 
@@ -216,6 +952,35 @@ livi_gst_paintable_unrealize (LiviGstPaintable *self,
     g_clear_object (&self->context);
 }
 
+static void
+livi_gst_paintable_update_offloadable (LiviGstPaintable *self)
+{
+  gboolean offloadable;
+
+  /* Only dmabufs drawn without clipping or transforms can be handed to the compositor */
+  offloadable = GDK_IS_DMABUF_TEXTURE (self->image) && viewport_covers_image (self) &&
+    self->orientation == GST_VIDEO_ORIENTATION_IDENTITY && !livi_gst_paintable_is_zoomed (self);
+  if (offloadable == self->offloadable)
+    return;
+
+  self->offloadable = offloadable;
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_OFFLOADABLE]);
+}
+
+static void
+livi_gst_paintable_set_overlays (LiviGstPaintable *self,
+                                 GPtrArray        *overlays)
+{
+  if (self->overlays == overlays)
+    return;
+
+  g_clear_pointer (&self->overlays, g_ptr_array_unref);
+  if (overlays)
+    self->overlays = g_ptr_array_ref (overlays);
+
+  gdk_paintable_invalidate_contents (GDK_PAINTABLE (self));
+}
+
 static void
 livi_gst_paintable_set_paintable (LiviGstPaintable      *self,
                                   GdkPaintable          *paintable,
@@ -249,54 +1014,525 @@ livi_gst_paintable_set_paintable (LiviGstPaintable      *self,
     gdk_paintable_invalidate_size (GDK_PAINTABLE (self));
 
   gdk_paintable_invalidate_contents (GDK_PAINTABLE (self));
-}
 
-typedef struct _SetTextureInvocation {
-  LiviGstPaintable *paintable;
-  GdkTexture       *texture;
-  double            pixel_aspect_ratio;
-  graphene_rect_t   viewport;
-} SetTextureInvocation;
+  livi_gst_paintable_update_offloadable (self);
+}
 
 static void
 set_texture_invocation_free (SetTextureInvocation *invoke)
 {
-  g_object_unref (invoke->paintable);
-  g_object_unref (invoke->texture);
+  g_clear_object (&invoke->texture);
+  g_clear_pointer (&invoke->overlays, g_ptr_array_unref);
+  if (invoke->frame_release)
+    invoke->frame_release (invoke->frame_data);
+  invoke->frame_release = NULL;
+  invoke->frame_data = NULL;
+
+  if (invoke->from_heap)
+    g_free (invoke);
+  else
+    g_atomic_int_set (&invoke->in_use, 0);
+}
+
+static SetTextureInvocation *
+set_texture_invocation_acquire (LiviGstPaintable *self)
+{
+  SetTextureInvocation *invoke;
 
-  g_slice_free (SetTextureInvocation, invoke);
+  for (guint i = 0; i < N_INVOCATIONS; i++) {
+    invoke = &self->invocations[i];
+
+    if (g_atomic_int_compare_and_exchange (&invoke->in_use, 0, 1))
+      return invoke;
+  }
+
+  /* Only happens with more than one streaming thread feeding us */
+  invoke = g_new0 (SetTextureInvocation, 1);
+  invoke->from_heap = TRUE;
+#ifdef LIVI_ENABLE_DEBUG
+  g_debug ("Out of invocation slots, %u heap allocations",
+           g_atomic_int_add (&self->n_invocation_allocs, 1) + 1);
+#else
+  g_atomic_int_inc (&self->n_invocation_allocs);
+#endif
+
+  return invoke;
 }
 
-static gboolean
-livi_gst_paintable_set_texture_invoke (gpointer data)
+static void
+livi_gst_paintable_emit_presented (LiviGstPaintable *self,
+                                   guint64           timestamp,
+                                   gint64            lateness_us)
+{
+  g_signal_emit (self, signals[FRAME_PRESENTED], 0, timestamp, lateness_us * 1000);
+}
+
+static void
+livi_gst_paintable_check_presented (LiviGstPaintable *self)
+{
+  for (guint i = 0; i < N_PRESENTED_FRAMES; i++) {
+    PresentedFrame *frame = &self->presented[i];
+    GdkFrameTimings *timings;
+    gint64 presentation_time, predicted_time, frame_time, refresh_interval;
+    gint64 lateness;
+
+    if (frame->frame_counter < 0)
+      continue;
+
+    timings = gdk_frame_clock_get_timings (self->frame_clock, frame->frame_counter);
+    if (timings == NULL) {
+      /* Dropped out of the frame clock's history */
+      frame->frame_counter = -1;
+      continue;
+    }
+
+    if (!gdk_frame_timings_get_complete (timings))
+      continue;
+
+    frame_time = gdk_frame_timings_get_frame_time (timings);
+    refresh_interval = gdk_frame_timings_get_refresh_interval (timings);
+    predicted_time = gdk_frame_timings_get_predicted_presentation_time (timings);
+    if (predicted_time == 0)
+      predicted_time = frame_time + refresh_interval;
+    presentation_time = gdk_frame_timings_get_presentation_time (timings);
+    if (presentation_time == 0)
+      presentation_time = predicted_time;
+
+    /*
+     * Waiting for the next frame cycle and the compositor's latency are
+     * expected. A frame is only late if it missed the first frame cycle
+     * after it was due or didn't make it to the screen when predicted.
+     */
+    lateness = MAX (frame_time - frame->due_time - refresh_interval, 0) +
+      (presentation_time - predicted_time);
+
+    livi_gst_paintable_emit_presented (self, frame->timestamp, lateness);
+    frame->frame_counter = -1;
+  }
+}
+
+static void
+livi_gst_paintable_release_frame (LiviGstPaintable *self, guint idx)
+{
+  g_clear_pointer (&self->frames[idx], livi_gst_frame_unref);
+}
+
+/* GSK might still be busy with the previous frame so keep that too */
+static void
+livi_gst_paintable_push_frame (LiviGstPaintable *self, LiviGstFrame *frame)
 {
-  SetTextureInvocation *invoke = data;
+  livi_gst_paintable_release_frame (self, 1);
+  self->frames[1] = self->frames[0];
+  self->frames[0] = frame;
+}
 
-  livi_gst_paintable_set_paintable (invoke->paintable,
+static void
+livi_gst_paintable_latch (LiviGstPaintable *self)
+{
+  SetTextureInvocation *invoke;
+
+  invoke = g_atomic_pointer_exchange (&self->pending, NULL);
+  if (invoke == NULL)
+    return;
+
+  livi_gst_paintable_set_paintable (self,
                                     GDK_PAINTABLE (invoke->texture),
                                     invoke->pixel_aspect_ratio,
                                     &invoke->viewport);
+  livi_gst_paintable_set_overlays (self, invoke->overlays);
+
+  livi_gst_paintable_push_frame (self, livi_gst_frame_new (invoke->frame_release,
+                                                           invoke->frame_data));
+  invoke->frame_release = NULL;
+  invoke->frame_data = NULL;
 
-  return G_SOURCE_REMOVE;
+  if (self->frame_clock) {
+    PresentedFrame *frame = &self->presented[self->presented_idx];
+
+    frame->frame_counter = gdk_frame_clock_get_frame_counter (self->frame_clock);
+    frame->timestamp = invoke->timestamp;
+    frame->due_time = invoke->due_time;
+    self->presented_idx = (self->presented_idx + 1) % N_PRESENTED_FRAMES;
+  } else {
+    /* No feedback without a frame clock, assume it's shown in time */
+    livi_gst_paintable_emit_presented (self, invoke->timestamp, 0);
+  }
+
+  set_texture_invocation_free (invoke);
 }
 
+static void
+on_frame_clock_before_paint (LiviGstPaintable *self)
+{
+  livi_gst_paintable_latch (self);
+  livi_gst_paintable_check_presented (self);
+}
+
+static void
+livi_gst_paintable_set_frame_clock (LiviGstPaintable *self,
+                                    GdkFrameClock    *frame_clock)
+{
+  if (self->frame_clock == frame_clock)
+    return;
+
+  if (self->frame_clock) {
+    g_signal_handlers_disconnect_by_data (self->frame_clock, self);
+    g_clear_object (&self->frame_clock);
+  }
+
+  for (guint i = 0; i < N_PRESENTED_FRAMES; i++)
+    self->presented[i].frame_counter = -1;
+
+  if (frame_clock == NULL)
+    return;
+
+  self->frame_clock = g_object_ref (frame_clock);
+  g_signal_connect_swapped (self->frame_clock, "before-paint",
+                            G_CALLBACK (on_frame_clock_before_paint), self);
+  g_signal_connect_swapped (self->frame_clock, "after-paint",
+                            G_CALLBACK (livi_gst_paintable_check_presented), self);
+}
+
+static gboolean
+livi_gst_paintable_set_texture_invoke (gpointer data)
+{
+  LiviGstPaintable *self = LIVI_GST_PAINTABLE (data);
+
+  /* Latch the frame right before the next paint */
+  if (self->frame_clock)
+    gdk_frame_clock_request_phase (self->frame_clock, GDK_FRAME_CLOCK_PHASE_BEFORE_PAINT);
+  else
+    livi_gst_paintable_latch (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * livi_gst_paintable_queue_set_texture:
+ * @self: The paintable
+ * @texture: The texture to show
+ * @pixel_aspect_ratio: The pixel aspect ratio
+ * @viewport: The visible part of the texture
+ * @timestamp: The timestamp reported back via `LiviGstPaintable::frame-presented`
+ * @overlays:(nullable)(element-type LiviGstOverlay): Overlays to draw on top of the texture
+ * @frame_release:(nullable): Function to release @frame_data
+ * @frame_data: Data backing the texture
+ *
+ * Hands a new frame over from the streaming thread. Only the latest
+ * frame is kept: if the main loop didn't pick up the previous one yet
+ * it is dropped and at most one wakeup is pending at any time.
+ *
+ * If the texture doesn't own its data @frame_data is kept alive
+ * until the texture is no longer shown.
+ *
+ * The frame is expected to be due right now, its lateness is measured
+ * against the time it actually reaches the screen.
+ */
 void
 livi_gst_paintable_queue_set_texture (LiviGstPaintable      *self,
                                       GdkTexture            *texture,
                                       double                 pixel_aspect_ratio,
-                                      const graphene_rect_t *viewport)
+                                      const graphene_rect_t *viewport,
+                                      guint64                timestamp,
+                                      GPtrArray             *overlays,
+                                      GDestroyNotify         frame_release,
+                                      gpointer               frame_data)
 {
-  SetTextureInvocation *invoke;
+  SetTextureInvocation *invoke, *old;
 
-  invoke = g_slice_new0 (SetTextureInvocation);
-  invoke->paintable = g_object_ref (self);
+  invoke = set_texture_invocation_acquire (self);
   invoke->texture = g_object_ref (texture);
   invoke->pixel_aspect_ratio = pixel_aspect_ratio;
   invoke->viewport = *viewport;
+  invoke->timestamp = timestamp;
+  invoke->due_time = g_get_monotonic_time ();
+  invoke->overlays = overlays ? g_ptr_array_ref (overlays) : NULL;
+  invoke->frame_release = frame_release;
+  invoke->frame_data = frame_data;
+
+  old = g_atomic_pointer_exchange (&self->pending, invoke);
+  if (old) {
+    /* A wakeup is already pending and will pick up the new frame */
+    g_atomic_int_inc (&self->n_dropped);
+    set_texture_invocation_free (old);
+    return;
+  }
+
+  g_source_set_ready_time (self->wakeup_source, 0);
+}
 
-  g_main_context_invoke_full (NULL,
-                              G_PRIORITY_DEFAULT,
-                              livi_gst_paintable_set_texture_invoke,
-                              invoke,
-                              (GDestroyNotify) set_texture_invocation_free);
+/**
+ * livi_gst_paintable_get_dropped_frames:
+ * @self: The paintable
+ *
+ * Returns: The number of frames that got superseded before the main
+ *   loop could show them.
+ */
+guint
+livi_gst_paintable_get_dropped_frames (LiviGstPaintable *self)
+{
+  g_return_val_if_fail (LIVI_IS_GST_PAINTABLE (self), 0);
+
+  return g_atomic_int_get (&self->n_dropped);
+}
+
+/**
+ * livi_gst_paintable_get_offloadable:
+ * @self: The paintable
+ *
+ * Returns: %TRUE if the current frame can be offloaded to a subsurface
+ */
+gboolean
+livi_gst_paintable_get_offloadable (LiviGstPaintable *self)
+{
+  g_return_val_if_fail (LIVI_IS_GST_PAINTABLE (self), FALSE);
+
+  return self->offloadable;
+}
+
+/**
+ * livi_gst_paintable_set_downscale:
+ * @self: The paintable
+ * @downscale: Whether to scale frames to the on screen size
+ *
+ * Scaling only happens for sinks created after this was enabled.
+ */
+void
+livi_gst_paintable_set_downscale (LiviGstPaintable *self, gboolean downscale)
+{
+  g_return_if_fail (LIVI_IS_GST_PAINTABLE (self));
+
+  if (self->downscale == downscale)
+    return;
+
+  self->downscale = downscale;
+  if (!downscale && (self->gl_scaler || self->sw_scaler))
+    livi_gst_paintable_set_target_size (self, 0, 0);
+  else
+    gdk_paintable_invalidate_contents (GDK_PAINTABLE (self));
+
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DOWNSCALE]);
+}
+
+/**
+ * livi_gst_paintable_set_held_frames:
+ * @self: The paintable
+ * @held_frames: The number of frames referenced outside the paintable
+ *
+ * Tells the sink how many frames are kept alive via
+ * livi_gst_paintable_get_frame () so it can account for them when
+ * proposing an allocation.
+ */
+void
+livi_gst_paintable_set_held_frames (LiviGstPaintable *self, guint held_frames)
+{
+  g_return_if_fail (LIVI_IS_GST_PAINTABLE (self));
+
+  if (self->held_frames == held_frames)
+    return;
+
+  self->held_frames = held_frames;
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_HELD_FRAMES]);
+}
+
+guint
+livi_gst_paintable_get_held_frames (LiviGstPaintable *self)
+{
+  g_return_val_if_fail (LIVI_IS_GST_PAINTABLE (self), 0);
+
+  return self->held_frames;
+}
+
+void
+livi_gst_overlay_free (LiviGstOverlay *overlay)
+{
+  g_clear_object (&overlay->texture);
+  g_free (overlay);
+}
+
+static LiviGstFrame *
+livi_gst_frame_new (GDestroyNotify release, gpointer data)
+{
+  LiviGstFrame *frame;
+
+  /* The texture owns its data */
+  if (release == NULL)
+    return NULL;
+
+  if (n_spare_frames > 0) {
+    frame = spare_frames[--n_spare_frames];
+  } else {
+    frame = g_new0 (LiviGstFrame, 1);
+    n_frame_allocs++;
+#ifdef LIVI_ENABLE_DEBUG
+    g_debug ("No spare frame, %u heap allocations", n_frame_allocs);
+#endif
+  }
+
+  frame->ref_count = 1;
+  frame->release = release;
+  frame->data = data;
+
+  return frame;
+}
+
+LiviGstFrame *
+livi_gst_frame_ref (LiviGstFrame *frame)
+{
+  g_return_val_if_fail (frame->ref_count > 0, NULL);
+
+  frame->ref_count++;
+
+  return frame;
+}
+
+void
+livi_gst_frame_unref (LiviGstFrame *frame)
+{
+  g_return_if_fail (frame->ref_count > 0);
+
+  if (--frame->ref_count > 0)
+    return;
+
+  frame->release (frame->data);
+  frame->release = NULL;
+  frame->data = NULL;
+
+  if (n_spare_frames < N_SPARE_FRAMES)
+    spare_frames[n_spare_frames++] = frame;
+  else
+    g_free (frame);
+}
+
+/**
+ * livi_gst_paintable_set_orientation:
+ * @self: The paintable
+ * @orientation: How to rotate or flip frames
+ *
+ * Sets the orientation frames are shown with, e.g. from the
+ * stream's image-orientation tag.
+ */
+void
+livi_gst_paintable_set_orientation (LiviGstPaintable          *self,
+                                    GstVideoOrientationMethod  orientation)
+{
+  gboolean size_changed;
+
+  g_return_if_fail (LIVI_IS_GST_PAINTABLE (self));
+
+  /* Only fixed orientations make sense here */
+  if (orientation > GST_VIDEO_ORIENTATION_UR_LL)
+    orientation = GST_VIDEO_ORIENTATION_IDENTITY;
+
+  if (self->orientation == orientation)
+    return;
+
+  size_changed = orientation_swaps_axes (self->orientation) != orientation_swaps_axes (orientation);
+  self->orientation = orientation;
+
+  if (size_changed)
+    gdk_paintable_invalidate_size (GDK_PAINTABLE (self));
+  gdk_paintable_invalidate_contents (GDK_PAINTABLE (self));
+  livi_gst_paintable_update_offloadable (self);
+}
+
+/**
+ * livi_gst_paintable_set_zoom:
+ * @self: The paintable
+ * @zoom:(nullable): The part of the frame to show
+ *
+ * Zooms into the frame. @zoom is in normalized coordinates of the
+ * oriented frame, %NULL shows the whole frame.
+ */
+void
+livi_gst_paintable_set_zoom (LiviGstPaintable      *self,
+                             const graphene_rect_t *zoom)
+{
+  graphene_rect_t full = GRAPHENE_RECT_INIT (0, 0, 1, 1);
+  graphene_rect_t rect;
+
+  g_return_if_fail (LIVI_IS_GST_PAINTABLE (self));
+
+  if (zoom == NULL || !graphene_rect_intersection (zoom, &full, &rect) ||
+      rect.size.width <= 0 || rect.size.height <= 0)
+    rect = full;
+
+  if (graphene_rect_equal (&self->zoom, &rect))
+    return;
+
+  self->zoom = rect;
+  gdk_paintable_invalidate_contents (GDK_PAINTABLE (self));
+  livi_gst_paintable_update_offloadable (self);
+}
+
+/**
+ * livi_gst_paintable_get_texture:
+ * @self: The paintable
+ *
+ * Returns:(transfer none)(nullable): The texture of the frame that is
+ *   currently shown
+ */
+GdkTexture *
+livi_gst_paintable_get_texture (LiviGstPaintable *self)
+{
+  g_return_val_if_fail (LIVI_IS_GST_PAINTABLE (self), NULL);
+
+  if (!GDK_IS_TEXTURE (self->image))
+    return NULL;
+
+  return GDK_TEXTURE (self->image);
+}
+
+/**
+ * livi_gst_paintable_get_frame:
+ * @self: The paintable
+ *
+ * Returns:(transfer none)(nullable): What keeps the data of the
+ *   current frame's texture alive or %NULL if the texture owns it
+ */
+LiviGstFrame *
+livi_gst_paintable_get_frame (LiviGstPaintable *self)
+{
+  g_return_val_if_fail (LIVI_IS_GST_PAINTABLE (self), NULL);
+
+  return self->frames[0];
+}
+
+/**
+ * livi_gst_paintable_show_texture:
+ * @self: The paintable
+ * @texture: The texture to show
+ * @frame:(nullable): What keeps the texture's data alive
+ *
+ * Shows @texture in place of the current frame, e.g. a frame that
+ * was shown before. It's drawn like the current frame and is replaced
+ * by the next frame coming from the stream.
+ */
+void
+livi_gst_paintable_show_texture (LiviGstPaintable *self,
+                                 GdkTexture       *texture,
+                                 LiviGstFrame     *frame)
+{
+  graphene_rect_t viewport;
+  int width, height;
+
+  g_return_if_fail (LIVI_IS_GST_PAINTABLE (self));
+  g_return_if_fail (GDK_IS_TEXTURE (texture));
+
+  width = gdk_texture_get_width (texture);
+  height = gdk_texture_get_height (texture);
+
+  /* The frame size might have changed since, e.g. due to downscaling */
+  if (self->image &&
+      gdk_paintable_get_intrinsic_width (self->image) == width &&
+      gdk_paintable_get_intrinsic_height (self->image) == height)
+    viewport = self->viewport;
+  else
+    viewport = GRAPHENE_RECT_INIT (0, 0, width, height);
+
+  livi_gst_paintable_set_paintable (self, GDK_PAINTABLE (texture),
+                                    self->pixel_aspect_ratio, &viewport);
+  livi_gst_paintable_push_frame (self, frame ? livi_gst_frame_ref (frame) : NULL);
+  /* Overlays belong to the frame they came with */
+  livi_gst_paintable_set_overlays (self, NULL);
 }
@@ -12,6 +12,7 @@
 
 #include <gdk/gdk.h>
 #include <graphene.h>
+#include <gst/video/video.h>
 
 G_BEGIN_DECLS
 
@@ -19,15 +20,69 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (LiviGstPaintable, livi_gst_paintable, LIVI, GST_PAINTABLE, GObject)
 
+/**
+ * LiviGstOverlay:
+ * @texture: The overlay's pixels
+ * @bounds: Where to draw the overlay in video frame coordinates
+ * @seqnum: Identifies the overlay rectangle the texture was created from
+ *
+ * An overlay like a bitmap subtitle drawn on top of the video.
+ */
+typedef struct _LiviGstOverlay {
+  GdkTexture      *texture;
+  graphene_rect_t  bounds;
+  guint            seqnum;
+} LiviGstOverlay;
+
+void livi_gst_overlay_free                    (LiviGstOverlay *overlay);
+
+/**
+ * LiviGstFrame:
+ *
+ * Keeps the buffer backing a frame's texture alive.
+ */
+typedef struct _LiviGstFrame LiviGstFrame;
+
+LiviGstFrame *livi_gst_frame_ref              (LiviGstFrame *frame);
+void livi_gst_frame_unref                     (LiviGstFrame *frame);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (LiviGstFrame, livi_gst_frame_unref)
+
 GdkPaintable *livi_gst_paintable_new          (void);
 
 void livi_gst_paintable_realize               (LiviGstPaintable *self,
                                                GdkSurface       *surface);
 void livi_gst_paintable_unrealize             (LiviGstPaintable *self,
                                                GdkSurface       *surface);
+void livi_gst_paintable_prepare_async         (LiviGstPaintable    *self,
+                                               GCancellable        *cancellable,
+                                               GAsyncReadyCallback  callback,
+                                               gpointer             user_data);
+gboolean livi_gst_paintable_prepare_finish    (LiviGstPaintable  *self,
+                                               GAsyncResult      *res,
+                                               GError           **error);
 void livi_gst_paintable_queue_set_texture     (LiviGstPaintable      *self,
                                                GdkTexture            *texture,
                                                double                 pixel_aspect_ratio,
-                                               const graphene_rect_t *viewport);
+                                               const graphene_rect_t *viewport,
+                                               guint64                timestamp,
+                                               GPtrArray             *overlays,
+                                               GDestroyNotify         frame_release,
+                                               gpointer               frame_data);
+guint livi_gst_paintable_get_dropped_frames   (LiviGstPaintable      *self);
+gboolean livi_gst_paintable_get_offloadable   (LiviGstPaintable      *self);
+void livi_gst_paintable_set_downscale         (LiviGstPaintable      *self,
+                                               gboolean               downscale);
+void livi_gst_paintable_set_held_frames       (LiviGstPaintable      *self,
+                                               guint                  held_frames);
+guint livi_gst_paintable_get_held_frames      (LiviGstPaintable      *self);
+void livi_gst_paintable_set_orientation       (LiviGstPaintable          *self,
+                                               GstVideoOrientationMethod  orientation);
+void livi_gst_paintable_set_zoom              (LiviGstPaintable      *self,
+                                               const graphene_rect_t *zoom);
+GdkTexture *livi_gst_paintable_get_texture    (LiviGstPaintable      *self);
+LiviGstFrame *livi_gst_paintable_get_frame    (LiviGstPaintable      *self);
+void livi_gst_paintable_show_texture          (LiviGstPaintable      *self,
+                                               GdkTexture            *texture,
+                                               LiviGstFrame          *frame);
 
 G_END_DECLS
@@ -17,6 +17,7 @@
 
 #include "livi-gst-paintable.h"
 
+#include <gtk/gtk.h>
 #include <gdk/wayland/gdkwayland.h>
 #include <gst/gl/wayland/gstgldisplay_wayland.h>
 
@@ -36,15 +37,87 @@ enum {
 };
 
 
+/* Frames that can be mapped at once without hitting the heap */
+#define N_FRAME_SLOTS 8
+
+typedef struct _LiviFramePool LiviFramePool;
+
+typedef struct _LiviFrameSlot {
+  GstVideoFrame  frame;
+  /* Multi planar system memory is mapped as a whole */
+  GstBuffer     *buffer;
+  GstMapInfo     map;
+  gint           in_use;
+  LiviFramePool *pool;
+} LiviFrameSlot;
+
+/* Refcounted as textures can outlive the sink */
+struct _LiviFramePool {
+  LiviFrameSlot  slots[N_FRAME_SLOTS];
+  /* Slots that had to be allocated as all of the above were in use */
+  guint          n_heap_slots;
+};
+
+typedef enum _LiviGlState {
+  LIVI_GL_STATE_NONE = 0,
+  LIVI_GL_STATE_PENDING,
+  LIVI_GL_STATE_READY,
+  LIVI_GL_STATE_FAILED,
+} LiviGlState;
+
 struct _LiviGstSink {
   GstVideoSink      parent;
 
   GstVideoInfo      v_info;
+  /* Colour state matching v_info's colorimetry if GDK supports it */
+  GdkColorState    *color_state;
   LiviGstPaintable *paintable;
   GdkGLContext     *gdk_context;
+  GdkDisplay       *display;
   GstGLDisplay     *gst_display;
   GstGLContext     *gst_app_context;
   GstGLContext     *gst_context;
+  LiviGlState       gl_state;
+  GCond             gl_cond;
+  /* Tasks waiting for the GL context, only touched on the main thread */
+  GPtrArray        *gl_waiters;
+
+  /* Reused across frames to avoid allocations on the streaming thread */
+  LiviFramePool      *frame_pool;
+  GdkGLTextureBuilder *gl_builder;
+  GdkMemoryTextureBuilder *memory_builder;
+#ifdef HAVE_GSTREAMER_DRM
+  GdkDmabufTextureBuilder *dmabuf_builder;
+#endif
+
+  /*
+   * The last dmabuf frame and its texture. The buffer is referenced so
+   * its contents can't change while the texture is reused for it.
+   */
+  GstBuffer          *dmabuf_buffer;
+  GdkTexture         *dmabuf_texture;
+
+  /* The previous system memory frame, to only upload what changed */
+  GdkTexture         *damage_texture;
+  GBytes             *damage_bytes;
+  gsize               damage_stride;
+  GstClockTime        damage_pts;
+
+  /* Textures for the overlay composition of the last frame */
+  GPtrArray          *overlays;
+  guint               overlays_seqnum;
+
+  /* QoS based on presentation feedback */
+  double            qos_proportion;
+  GstClockTime      avg_latency;
+  gboolean          qos_late;
+  guint             pool_min_buffers;
+  /* Frames referenced outside the paintable, e.g. while stepping */
+  guint             held_buffers;
+
+  /* Size upstream should scale to, 0 if not scaling */
+  int               target_width;
+  int               target_height;
 
 #ifdef HAVE_GSTREAMER_DRM
   GstVideoInfoDmaDrm  drm_info;
@@ -55,10 +128,41 @@ struct _LiviGstSink {
 GST_DEBUG_CATEGORY (livi_debug_gst_sink);
 #define GST_CAT_DEFAULT livi_debug_gst_sink
 
-#define FORMATS "{ BGRA, ARGB, RGBA, ABGR, RGB, BGR }"
+#if GTK_CHECK_VERSION (4, 20, 0)
+/* GDK can sample these directly so colour conversion happens in the renderer */
+#define YUV_FORMATS ", NV12, NV21, I420, YV12, P010_10LE"
+#else
+#define YUV_FORMATS ""
+#endif
+
+/* GDK's 16 bit formats use native endianness */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define DEEP_FORMATS ", RGBA64_LE"
+#else
+#define DEEP_FORMATS ""
+#endif
+
+#define FORMATS "{ BGRA, ARGB, RGBA, ABGR, RGB, BGR" DEEP_FORMATS YUV_FORMATS " }"
 
 #define NOGL_CAPS GST_VIDEO_CAPS_MAKE (FORMATS)
 
+#define GL_CAPS                                                 \
+  "video/x-raw(" GST_CAPS_FEATURE_MEMORY_GL_MEMORY "), "        \
+  "format = (string) { RGBA" DEEP_FORMATS " }, "                \
+  "width = " GST_VIDEO_SIZE_RANGE ", "                          \
+  "height = " GST_VIDEO_SIZE_RANGE ", "                         \
+  "framerate = " GST_VIDEO_FPS_RANGE ", "                       \
+  "texture-target = (string) 2D"
+
+/*
+ * We hold on to the current and the previous frame, one can be pending
+ * in the paintable's mailbox and one waits for its render time
+ */
+#define MIN_POOL_BUFFERS 4
+#define MAX_POOL_BUFFERS 12
+
+static gboolean livi_gst_sink_wait_gl_locked (LiviGstSink *self);
+
 static GstStaticPadTemplate livi_gst_sink_template =
   GST_STATIC_PAD_TEMPLATE ("sink",
                            GST_PAD_SINK,
@@ -67,13 +171,8 @@ static GstStaticPadTemplate livi_gst_sink_template =
 #ifdef HAVE_GSTREAMER_DRM
                                             GST_VIDEO_DMA_DRM_CAPS_MAKE "; "
 #endif
-                                            "video/x-raw(" GST_CAPS_FEATURE_MEMORY_GL_MEMORY "), "
-                                            "format = (string) RGBA, "
-                                            "width = " GST_VIDEO_SIZE_RANGE ", "
-                                            "height = " GST_VIDEO_SIZE_RANGE ", "
-                                            "framerate = " GST_VIDEO_FPS_RANGE ", "
-                                            "texture-target = (string) 2D"
-                                            "; " NOGL_CAPS)
+                                            GL_CAPS "; "
+                                            NOGL_CAPS)
                            );
 
 G_DEFINE_TYPE_WITH_CODE (LiviGstSink, livi_gst_sink,
@@ -119,6 +218,10 @@ add_drm_formats_and_modifiers (GstCaps          *caps,
 
   g_value_init (&dmabuf_list, GST_TYPE_LIST);
 
+  /*
+   * GDK sorts formats by preference with the ones the compositor can
+   * scan out first. Keep that order as fixation picks the first match.
+   */
   for (i = 0; i < gdk_dmabuf_formats_get_n_formats (dmabuf_formats); i++) {
       GValue value = G_VALUE_INIT;
       gchar *drm_format_string;
@@ -142,8 +245,76 @@ add_drm_formats_and_modifiers (GstCaps          *caps,
   gst_structure_take_value (gst_caps_get_structure (caps, 0), "drm-format",
                             &dmabuf_list);
 }
+
+#define DMABUF_CAPS_KEY "livi-gst-sink-dmabuf-caps"
+
+/*
+ * The dmabuf formats don't change for a display so only build the caps
+ * once per display instead of on every caps query.
+ */
+static GstCaps *
+livi_gst_sink_get_dmabuf_caps (LiviGstSink *self)
+{
+  static GMutex lock;
+  GstCaps *caps;
+
+  g_mutex_lock (&lock);
+  caps = g_object_get_data (G_OBJECT (self->display), DMABUF_CAPS_KEY);
+  if (caps == NULL) {
+    caps = gst_caps_from_string (GST_VIDEO_DMA_DRM_CAPS_MAKE);
+    add_drm_formats_and_modifiers (caps, gdk_display_get_dmabuf_formats (self->display));
+    GST_DEBUG_OBJECT (self, "dmabuf caps for %p: %" GST_PTR_FORMAT, self->display, caps);
+    g_object_set_data_full (G_OBJECT (self->display), DMABUF_CAPS_KEY, caps,
+                            (GDestroyNotify) gst_caps_unref);
+  }
+  caps = gst_caps_copy (caps);
+  g_mutex_unlock (&lock);
+
+  return caps;
+}
 #endif
 
+static GstCaps *
+livi_gst_sink_caps_for_target (const char *caps_str, int target_width, int target_height)
+{
+  GstCaps *caps = gst_caps_from_string (caps_str);
+
+  if (target_width > 0 && target_height > 0) {
+    gst_caps_set_simple (caps,
+                         "width", GST_TYPE_INT_RANGE, 1, target_width,
+                         "height", GST_TYPE_INT_RANGE, 1, target_height,
+                         NULL);
+  }
+
+  return caps;
+}
+
+/*
+ * Prefer getting overlays like subtitles as meta so we can draw them on
+ * top of the untouched frame instead of upstream blending them in.
+ */
+static GstCaps *
+livi_gst_sink_add_overlay_caps (GstCaps *caps)
+{
+  GstCaps *overlay_caps = gst_caps_copy (caps);
+
+  for (guint i = 0; i < gst_caps_get_size (overlay_caps); i++) {
+    GstCapsFeatures *features = gst_caps_get_features (overlay_caps, i);
+
+    if (features && gst_caps_features_is_any (features))
+      continue;
+
+    features = features ? gst_caps_features_copy (features) :
+      gst_caps_features_new (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY, NULL);
+    gst_caps_features_add (features, GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION);
+    gst_caps_set_features (overlay_caps, i, features);
+  }
+
+  gst_caps_append (overlay_caps, caps);
+
+  return overlay_caps;
+}
+
 static GstCaps *
 livi_gst_sink_get_caps (GstBaseSink *bsink,
                         GstCaps     *filter)
@@ -151,21 +322,36 @@ livi_gst_sink_get_caps (GstBaseSink *bsink,
   LiviGstSink *self = LIVI_GST_SINK (bsink);
   g_autoptr (GstCaps) tmp = NULL;
   GstCaps *result;
+  gboolean have_gl;
+  int target_width, target_height;
 
-  if (self->gst_context) {
-    tmp = gst_pad_get_pad_template_caps (GST_BASE_SINK_PAD (bsink));
-#ifdef HAVE_GSTREAMER_DRM
-    {
-      GdkDisplay *display = gdk_gl_context_get_display (self->gdk_context);
-      GdkDmabufFormats *formats = gdk_display_get_dmabuf_formats (display);
+  GST_OBJECT_LOCK (self);
+  have_gl = livi_gst_sink_wait_gl_locked (self);
+  target_width = self->target_width;
+  target_height = self->target_height;
+  GST_OBJECT_UNLOCK (self);
 
-      tmp = gst_caps_make_writable (tmp);
-      add_drm_formats_and_modifiers (tmp, formats);
-    }
+#ifdef HAVE_GSTREAMER_DRM
+  /* Importing dmabufs only needs GDK, not a GStreamer GL context */
+  if (self->display)
+    tmp = livi_gst_sink_get_dmabuf_caps (self);
+  else
 #endif
+    tmp = gst_caps_new_empty ();
+
+  /*
+   * Let the scaler in front of us shrink frames to the on screen
+   * size. That's glcolorscale with GL and videoconvertscale otherwise.
+   */
+  if (have_gl) {
+    gst_caps_append (tmp, livi_gst_sink_caps_for_target (GL_CAPS, target_width, target_height));
+    gst_caps_append (tmp, gst_caps_from_string (NOGL_CAPS));
   } else {
-    tmp = gst_caps_from_string (NOGL_CAPS);
+    gst_caps_append (tmp, livi_gst_sink_caps_for_target (NOGL_CAPS, target_width, target_height));
   }
+
+  tmp = livi_gst_sink_add_overlay_caps (tmp);
+
   GST_DEBUG_OBJECT (self, "advertising own caps %" GST_PTR_FORMAT, tmp);
 
   if (filter) {
@@ -181,6 +367,53 @@ livi_gst_sink_get_caps (GstBaseSink *bsink,
   return result;
 }
 
+static void
+dmabuf_texture_clear (LiviGstSink *self)
+{
+  gst_clear_buffer (&self->dmabuf_buffer);
+  g_clear_object (&self->dmabuf_texture);
+}
+
+static GdkColorState *
+livi_gst_color_state_from_video_info (GstVideoInfo *info)
+{
+  const GstVideoColorimetry *colorimetry = &GST_VIDEO_INFO_COLORIMETRY (info);
+  g_autoptr (GdkCicpParams) params = gdk_cicp_params_new ();
+  g_autoptr (GError) err = NULL;
+  GdkColorState *color_state;
+
+  gdk_cicp_params_set_color_primaries (params, gst_video_color_primaries_to_iso (colorimetry->primaries));
+  gdk_cicp_params_set_transfer_function (params, gst_video_transfer_function_to_iso (colorimetry->transfer));
+  gdk_cicp_params_set_matrix_coefficients (params, GST_VIDEO_INFO_IS_YUV (info) ?
+                                           gst_video_color_matrix_to_iso (colorimetry->matrix) : 0);
+  gdk_cicp_params_set_range (params, colorimetry->range == GST_VIDEO_COLOR_RANGE_16_235 ?
+                             GDK_CICP_RANGE_NARROW : GDK_CICP_RANGE_FULL);
+
+  /* Older GTK might not handle YUV matrices or ranges, let GDK pick then */
+  color_state = gdk_cicp_params_build_color_state (params, &err);
+  if (color_state == NULL)
+    GST_DEBUG ("Unsupported colorimetry: %s", err->message);
+
+  return color_state;
+}
+
+static void
+qos_reset_locked (LiviGstSink *self)
+{
+  self->qos_proportion = 1.0;
+  self->avg_latency = 0;
+  self->qos_late = FALSE;
+}
+
+static void
+damage_clear (LiviGstSink *self)
+{
+  g_clear_object (&self->damage_texture);
+  g_clear_pointer (&self->damage_bytes, g_bytes_unref);
+  self->damage_stride = 0;
+  self->damage_pts = GST_CLOCK_TIME_NONE;
+}
+
 static gboolean
 livi_gst_sink_set_caps (GstBaseSink *bsink,
                         GstCaps     *caps)
@@ -189,6 +422,19 @@ livi_gst_sink_set_caps (GstBaseSink *bsink,
 
   GST_DEBUG_OBJECT (self, "set caps with %" GST_PTR_FORMAT, caps);
 
+  GST_OBJECT_LOCK (self);
+  dmabuf_texture_clear (self);
+  qos_reset_locked (self);
+  GST_OBJECT_UNLOCK (self);
+
+  damage_clear (self);
+  /* Don't carry over plane layouts or colour states from a previous format */
+  g_clear_object (&self->memory_builder);
+  g_clear_object (&self->gl_builder);
+#ifdef HAVE_GSTREAMER_DRM
+  g_clear_object (&self->dmabuf_builder);
+#endif
+
 #ifdef HAVE_GSTREAMER_DRM
   if (gst_video_is_dma_drm_caps (caps)) {
     if (!gst_video_info_dma_drm_from_caps (&self->drm_info, caps))
@@ -206,6 +452,41 @@ livi_gst_sink_set_caps (GstBaseSink *bsink,
   }
 #endif
 
+  /* Colour conversion happens once in GSK */
+  g_clear_pointer (&self->color_state, gdk_color_state_unref);
+  self->color_state = livi_gst_color_state_from_video_info (&self->v_info);
+
+  return TRUE;
+}
+
+static gboolean
+livi_gst_sink_event (GstBaseSink *bsink,
+                     GstEvent    *event)
+{
+  LiviGstSink *self = LIVI_GST_SINK (bsink);
+
+  /* Lateness from before a seek says nothing about what comes next */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    GST_OBJECT_LOCK (self);
+    qos_reset_locked (self);
+    /* Damage metas after a flush aren't relative to the frame we have */
+    self->damage_pts = GST_CLOCK_TIME_NONE;
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  return GST_BASE_SINK_CLASS (livi_gst_sink_parent_class)->event (bsink, event);
+}
+
+static gboolean
+livi_gst_sink_stop (GstBaseSink *bsink)
+{
+  LiviGstSink *self = LIVI_GST_SINK (bsink);
+
+  /* Upstream releases its pool when going to READY */
+  GST_OBJECT_LOCK (self);
+  dmabuf_texture_clear (self);
+  GST_OBJECT_UNLOCK (self);
+
   return TRUE;
 }
 
@@ -214,9 +495,15 @@ livi_gst_sink_query (GstBaseSink *bsink,
                      GstQuery    *query)
 {
   LiviGstSink *self = LIVI_GST_SINK (bsink);
+  gboolean have_gl = FALSE;
 
-  if (GST_QUERY_TYPE (query) == GST_QUERY_CONTEXT &&
-      self->gst_display != NULL &&
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CONTEXT) {
+    GST_OBJECT_LOCK (self);
+    have_gl = livi_gst_sink_wait_gl_locked (self);
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  if (have_gl &&
       gst_gl_handle_context_query (GST_ELEMENT (self), query, self->gst_display, self->gst_context, self->gst_app_context))
     return TRUE;
 
@@ -231,13 +518,10 @@ livi_gst_sink_propose_allocation (GstBaseSink *bsink,
   g_autoptr (GstBufferPool) pool = NULL;
   GstStructure *config;
   GstCaps *caps;
-  guint size;
+  guint size, min_buffers;
   gboolean need_pool;
   GstVideoInfo info;
 
-  if (!self->gst_context)
-    return FALSE;
-
   gst_query_parse_allocation (query, &caps, &need_pool);
 
   if (caps == NULL) {
@@ -245,16 +529,38 @@ livi_gst_sink_propose_allocation (GstBaseSink *bsink,
     return FALSE;
   }
 
+  /*
+   * We honour strides, offsets and cropping in all modes so upstream
+   * can hand over padded buffers without copying.
+   */
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, 0);
+  gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, 0);
+  gst_query_add_allocation_meta (query, GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE, 0);
+
+  GST_OBJECT_LOCK (self);
+  min_buffers = self->pool_min_buffers + self->held_buffers;
+  GST_OBJECT_UNLOCK (self);
+
 #ifdef HAVE_GSTREAMER_DRM
-  if (gst_caps_features_contains (gst_caps_get_features (caps, 0), GST_CAPS_FEATURE_MEMORY_DMABUF)) {
-      gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, 0);
-      return TRUE;
+  if (gst_video_is_dma_drm_caps (caps)) {
+    GstVideoInfoDmaDrm drm_info;
+
+    size = 0;
+    if (gst_video_info_dma_drm_from_caps (&drm_info, caps) &&
+        gst_video_info_dma_drm_to_video_info (&drm_info, &info)) {
+      size = info.size;
+    }
+
+    /*
+     * We can't allocate buffers the decoder can use so let it keep its
+     * pool but tell it how many buffers we hold on to
+     */
+    GST_DEBUG_OBJECT (self, "Proposing %u dmabufs", min_buffers);
+    gst_query_add_allocation_pool (query, NULL, size, min_buffers, 0);
+    return TRUE;
   }
 #endif
 
-  if (!gst_caps_features_contains (gst_caps_get_features (caps, 0), GST_CAPS_FEATURE_MEMORY_GL_MEMORY))
-    return FALSE;
-
   if (!gst_video_info_from_caps (&info, caps)) {
     GST_DEBUG_OBJECT (self, "invalid caps specified");
     return FALSE;
@@ -263,12 +569,18 @@ livi_gst_sink_propose_allocation (GstBaseSink *bsink,
   /* the normal size of a frame */
   size = info.size;
 
+  if (!self->gst_context ||
+      !gst_caps_features_contains (gst_caps_get_features (caps, 0), GST_CAPS_FEATURE_MEMORY_GL_MEMORY)) {
+    gst_query_add_allocation_pool (query, NULL, size, min_buffers, 0);
+    return TRUE;
+  }
+
   if (need_pool) {
     GST_DEBUG_OBJECT (self, "create new pool");
     pool = gst_gl_buffer_pool_new (self->gst_context);
 
     config = gst_buffer_pool_get_config (pool);
-    gst_buffer_pool_config_set_params (config, caps, size, 0, 0);
+    gst_buffer_pool_config_set_params (config, caps, size, min_buffers, 0);
     gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_GL_SYNC_META);
 
     if (!gst_buffer_pool_set_config (pool, config)) {
@@ -277,11 +589,7 @@ livi_gst_sink_propose_allocation (GstBaseSink *bsink,
     }
   }
 
-  /* we need at least 2 buffer because we hold on to the last one */
-  gst_query_add_allocation_pool (query, pool, size, 2, 0);
-
-  /* we also support various metadata */
-  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, 0);
+  gst_query_add_allocation_pool (query, pool, size, min_buffers, 0);
 
   if (self->gst_context->gl_vtable->FenceSync)
     gst_query_add_allocation_meta (query, GST_GL_SYNC_META_API_TYPE, 0);
@@ -306,26 +614,323 @@ livi_gst_memory_format_from_video_info (GstVideoInfo *info)
     return GDK_MEMORY_R8G8B8;
   case GST_VIDEO_FORMAT_BGR:
     return GDK_MEMORY_B8G8R8;
+  case GST_VIDEO_FORMAT_RGBA64_LE:
+    return GDK_MEMORY_R16G16B16A16;
+#if GTK_CHECK_VERSION (4, 20, 0)
+  case GST_VIDEO_FORMAT_NV12:
+    return GDK_MEMORY_G8_B8R8_420;
+  case GST_VIDEO_FORMAT_NV21:
+    return GDK_MEMORY_G8_R8B8_420;
+  case GST_VIDEO_FORMAT_I420:
+    return GDK_MEMORY_G8_B8_R8_420;
+  case GST_VIDEO_FORMAT_YV12:
+    return GDK_MEMORY_G8_R8_B8_420;
+  case GST_VIDEO_FORMAT_P010_10LE:
+    return GDK_MEMORY_G10X6_B10X6R10X6_420;
+#endif
   default:
     g_assert_not_reached ();
     return GDK_MEMORY_A8R8G8B8;
   }
 }
 
+static LiviFrameSlot *
+frame_slot_acquire (LiviFramePool *pool)
+{
+  LiviFrameSlot *slot;
+
+  for (guint i = 0; i < N_FRAME_SLOTS; i++) {
+    slot = &pool->slots[i];
+
+    if (g_atomic_int_compare_and_exchange (&slot->in_use, 0, 1)) {
+      slot->pool = g_atomic_rc_box_acquire (pool);
+      return slot;
+    }
+  }
+
+#ifdef LIVI_ENABLE_DEBUG
+  g_debug ("Frame pool exhausted, %u heap allocations",
+           g_atomic_int_add (&pool->n_heap_slots, 1) + 1);
+#else
+  g_atomic_int_inc (&pool->n_heap_slots);
+#endif
+  return g_new0 (LiviFrameSlot, 1);
+}
+
+static void
+frame_slot_release (LiviFrameSlot *slot)
+{
+  LiviFramePool *pool = slot->pool;
+
+  if (pool == NULL) {
+    g_free (slot);
+    return;
+  }
+
+  slot->pool = NULL;
+  g_atomic_int_set (&slot->in_use, 0);
+  g_atomic_rc_box_release (pool);
+}
+
+static void
+video_frame_free (LiviFrameSlot *slot)
+{
+  gst_video_frame_unmap (&slot->frame);
+  frame_slot_release (slot);
+}
+
+#if GTK_CHECK_VERSION (4, 20, 0)
 static void
-video_frame_free (GstVideoFrame *frame)
+buffer_map_free (LiviFrameSlot *slot)
+{
+  gst_buffer_unmap (slot->buffer, &slot->map);
+  g_clear_pointer (&slot->buffer, gst_buffer_unref);
+  frame_slot_release (slot);
+}
+
+/*
+ * Planar formats need all planes in one GBytes so map the buffer as a
+ * whole and use the plane offsets within that mapping.
+ */
+static GdkTexture *
+livi_gst_sink_planar_texture_from_buffer (LiviGstSink   *self,
+                                          LiviFrameSlot *slot,
+                                          GstBuffer     *buffer)
+{
+  GdkMemoryTextureBuilder *builder;
+  const GstVideoMeta *vmeta = gst_buffer_get_video_meta (buffer);
+  g_autoptr (GBytes) bytes = NULL;
+  guint n_planes = GST_VIDEO_INFO_N_PLANES (&self->v_info);
+
+  if (!gst_buffer_map (buffer, &slot->map, GST_MAP_READ))
+    return NULL;
+  slot->buffer = gst_buffer_ref (buffer);
+
+  bytes = g_bytes_new_with_free_func (slot->map.data,
+                                      slot->map.size,
+                                      (GDestroyNotify) buffer_map_free,
+                                      slot);
+
+  if (self->memory_builder == NULL)
+    self->memory_builder = gdk_memory_texture_builder_new ();
+  builder = self->memory_builder;
+
+  gdk_memory_texture_builder_set_bytes (builder, bytes);
+  gdk_memory_texture_builder_set_format (builder, livi_gst_memory_format_from_video_info (&self->v_info));
+  gdk_memory_texture_builder_set_width (builder, GST_VIDEO_INFO_WIDTH (&self->v_info));
+  gdk_memory_texture_builder_set_height (builder, GST_VIDEO_INFO_HEIGHT (&self->v_info));
+
+  for (guint i = 0; i < n_planes; i++) {
+    gdk_memory_texture_builder_set_offset (builder, i,
+                                           vmeta ? vmeta->offset[i] : GST_VIDEO_INFO_PLANE_OFFSET (&self->v_info, i));
+    gdk_memory_texture_builder_set_stride_for_plane (builder, i,
+                                                     vmeta ? vmeta->stride[i] : GST_VIDEO_INFO_PLANE_STRIDE (&self->v_info, i));
+  }
+
+  gdk_memory_texture_builder_set_color_state (builder, self->color_state ? self->color_state : gdk_color_state_get_srgb ());
+
+  return gdk_memory_texture_builder_build (builder);
+}
+#endif
+
+#define DAMAGE_TILE_SIZE 64
+/* Beyond that uploading the whole frame is cheaper than tracking tiles */
+#define DAMAGE_MAX_PERCENT 50
+
+#define DAMAGE_ROI_TYPE "damage"
+
+/*
+ * Upstream can flag changed areas with region of interest metas of type
+ * "damage". These are relative to the previous buffer so only use them
+ * if the stream moved forward from the last frame we showed without a
+ * discontinuity or flush in between.
+ */
+static cairo_region_t *
+livi_gst_sink_damage_from_meta (LiviGstSink   *self,
+                                GstBuffer     *buffer,
+                                GstVideoFrame *frame)
+{
+  GstVideoRegionOfInterestMeta *meta;
+  cairo_region_t *region = NULL;
+  gpointer state = NULL;
+  GQuark damage_quark = g_quark_from_static_string (DAMAGE_ROI_TYPE);
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT) ||
+      !GST_CLOCK_TIME_IS_VALID (self->damage_pts) ||
+      !GST_BUFFER_PTS_IS_VALID (buffer) ||
+      GST_BUFFER_PTS (buffer) <= self->damage_pts)
+    return NULL;
+
+  while ((meta = (GstVideoRegionOfInterestMeta *)
+          gst_buffer_iterate_meta_filtered (buffer, &state,
+                                            GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+    if (meta->roi_type != damage_quark)
+      continue;
+
+    if (region == NULL)
+      region = cairo_region_create ();
+
+    cairo_region_union_rectangle (region, &(cairo_rectangle_int_t) {
+        meta->x, meta->y, meta->w, meta->h });
+  }
+
+  /* Don't trust upstream to stay within the frame */
+  if (region) {
+    cairo_region_intersect_rectangle (region, &(cairo_rectangle_int_t) {
+        0, 0, GST_VIDEO_INFO_WIDTH (&frame->info), GST_VIDEO_INFO_HEIGHT (&frame->info) });
+  }
+
+  return region;
+}
+
+/*
+ * Compare the frame with the previous one tile by tile. memcmp () is
+ * vectorized by libc and bails out at the first difference so unchanged
+ * content is cheap to detect.
+ */
+static cairo_region_t *
+livi_gst_sink_damage_from_diff (LiviGstSink   *self,
+                                GstVideoFrame *frame)
+{
+  const guint8 *prev = g_bytes_get_data (self->damage_bytes, NULL);
+  const guint8 *cur = frame->data[0];
+  gsize prev_stride = self->damage_stride;
+  gsize cur_stride = frame->info.stride[0];
+  int width = GST_VIDEO_INFO_WIDTH (&frame->info);
+  int height = GST_VIDEO_INFO_HEIGHT (&frame->info);
+  int bpp = GST_VIDEO_FRAME_COMP_PSTRIDE (frame, 0);
+  guint64 n_tiles = 0, n_damaged = 0;
+  cairo_region_t *region;
+
+  region = cairo_region_create ();
+  for (int ty = 0; ty < height; ty += DAMAGE_TILE_SIZE) {
+    int th = MIN (DAMAGE_TILE_SIZE, height - ty);
+
+    for (int tx = 0; tx < width; tx += DAMAGE_TILE_SIZE) {
+      int tw = MIN (DAMAGE_TILE_SIZE, width - tx);
+
+      n_tiles++;
+      for (int y = ty; y < ty + th; y++) {
+        if (memcmp (prev + y * prev_stride + tx * bpp,
+                    cur + y * cur_stride + tx * bpp,
+                    tw * bpp) != 0) {
+          cairo_region_union_rectangle (region, &(cairo_rectangle_int_t) { tx, ty, tw, th });
+          n_damaged++;
+          break;
+        }
+      }
+    }
+  }
+
+  if (n_damaged * 100 > n_tiles * DAMAGE_MAX_PERCENT)
+    g_clear_pointer (&region, cairo_region_destroy);
+
+  return region;
+}
+
+/*
+ * Figure out which part of a system memory frame changed compared to
+ * the previous one.
+ *
+ * Returns: (nullable): The changed region or %NULL if the whole frame
+ *   needs to be uploaded.
+ */
+static cairo_region_t *
+livi_gst_sink_get_damage (LiviGstSink   *self,
+                          GstBuffer     *buffer,
+                          GstVideoFrame *frame)
 {
-  gst_video_frame_unmap (frame);
-  g_free (frame);
+  cairo_region_t *region;
+
+  if (self->damage_texture == NULL)
+    return NULL;
+
+  if (gdk_texture_get_width (self->damage_texture) != GST_VIDEO_INFO_WIDTH (&frame->info) ||
+      gdk_texture_get_height (self->damage_texture) != GST_VIDEO_INFO_HEIGHT (&frame->info))
+    return NULL;
+
+  region = livi_gst_sink_damage_from_meta (self, buffer, frame);
+  if (region)
+    return region;
+
+  return livi_gst_sink_damage_from_diff (self, frame);
 }
 
+/*
+ * Wraps packed system memory, telling GDK which part changed since the
+ * previous frame so it only needs to upload that.
+ */
+static GdkTexture *
+livi_gst_sink_memory_texture_from_frame (LiviGstSink   *self,
+                                         LiviFrameSlot *slot,
+                                         GstBuffer     *buffer)
+{
+  GstVideoFrame *frame = &slot->frame;
+  GdkMemoryTextureBuilder *builder;
+  cairo_region_t *damage;
+  GdkTexture *texture;
+  GBytes *bytes;
+
+  /* The mapped frame's info uses stride and offset from GstVideoMeta if present */
+  bytes = g_bytes_new_with_free_func (frame->data[0],
+                                      frame->info.height * frame->info.stride[0],
+                                      (GDestroyNotify) video_frame_free,
+                                      slot);
+
+  if (self->memory_builder == NULL)
+    self->memory_builder = gdk_memory_texture_builder_new ();
+  builder = self->memory_builder;
+
+  gdk_memory_texture_builder_set_bytes (builder, bytes);
+  gdk_memory_texture_builder_set_format (builder, livi_gst_memory_format_from_video_info (&frame->info));
+  gdk_memory_texture_builder_set_width (builder, frame->info.width);
+  gdk_memory_texture_builder_set_height (builder, frame->info.height);
+  gdk_memory_texture_builder_set_stride (builder, frame->info.stride[0]);
+  gdk_memory_texture_builder_set_color_state (builder, self->color_state ? self->color_state : gdk_color_state_get_srgb ());
+
+  damage = livi_gst_sink_get_damage (self, buffer, frame);
+  if (damage) {
+    GST_TRACE_OBJECT (self, "Updating %d rectangles", cairo_region_num_rectangles (damage));
+    gdk_memory_texture_builder_set_update_texture (builder, self->damage_texture);
+    gdk_memory_texture_builder_set_update_region (builder, damage);
+  }
+
+  texture = gdk_memory_texture_builder_build (builder);
+
+  /* The builder only holds on to the current frame which we keep around anyway */
+  gdk_memory_texture_builder_set_update_texture (builder, NULL);
+  gdk_memory_texture_builder_set_update_region (builder, NULL);
+  g_clear_pointer (&damage, cairo_region_destroy);
+
+  /* Keep the frame mapped so the next one can be compared against it */
+  g_set_object (&self->damage_texture, texture);
+  g_clear_pointer (&self->damage_bytes, g_bytes_unref);
+  self->damage_bytes = bytes;
+  self->damage_stride = frame->info.stride[0];
+  self->damage_pts = GST_BUFFER_PTS (buffer);
+
+  return texture;
+}
+
+/*
+ * Wraps the buffer in a texture. A dmabuf buffer that is pushed again
+ * while we still hold it reuses its texture so GSK doesn't need to
+ * import it again. These textures don't keep the buffer alive,
+ * @frame_release and @frame_data must be kept around as long as the
+ * texture is in use instead.
+ */
 static GdkTexture *
 livi_gst_sink_texture_from_buffer (LiviGstSink     *self,
                                    GstBuffer       *buffer,
                                    double          *pixel_aspect_ratio,
-                                   graphene_rect_t *viewport)
+                                   graphene_rect_t *viewport,
+                                   GDestroyNotify  *frame_release,
+                                   gpointer        *frame_data)
 {
-  GstVideoFrame *frame = g_new (GstVideoFrame, 1);
+  LiviFrameSlot *slot = frame_slot_acquire (self->frame_pool);
+  GstVideoFrame *frame = &slot->frame;
+  GstMemory *mem0 = gst_buffer_peek_memory (buffer, 0);
+  GstVideoCropMeta *crop_meta;
   GdkTexture *texture;
 
   viewport->origin.x = 0;
@@ -333,27 +938,58 @@ livi_gst_sink_texture_from_buffer (LiviGstSink     *self,
   viewport->size.width = GST_VIDEO_INFO_WIDTH (&self->v_info);
   viewport->size.height = GST_VIDEO_INFO_HEIGHT (&self->v_info);
 
+  crop_meta = gst_buffer_get_video_crop_meta (buffer);
+  if (crop_meta) {
+    viewport->origin.x = crop_meta->x;
+    viewport->origin.y = crop_meta->y;
+    viewport->size.width = crop_meta->width;
+    viewport->size.height = crop_meta->height;
+  }
+
+  *frame_release = NULL;
+  *frame_data = NULL;
+
 #ifdef HAVE_GSTREAMER_DRM
-  if (gst_is_dmabuf_memory (gst_buffer_peek_memory (buffer, 0))) {
-    g_autoptr (GdkDmabufTextureBuilder) builder = NULL;
+  if (gst_is_dmabuf_memory (mem0)) {
+    GdkDmabufTextureBuilder *builder;
     const GstVideoMeta *vmeta = gst_buffer_get_video_meta (buffer);
     GError *error = NULL;
     int i;
 
     /* We don't map dmabufs */
-    g_clear_pointer (&frame, g_free);
+    g_clear_pointer (&slot, frame_slot_release);
 
     g_return_val_if_fail (vmeta, NULL);
-    g_return_val_if_fail (self->gdk_context, NULL);
+    g_return_val_if_fail (self->display, NULL);
     g_return_val_if_fail (self->drm_info.drm_fourcc != DRM_FORMAT_INVALID, NULL);
 
-    builder = gdk_dmabuf_texture_builder_new ();
-    gdk_dmabuf_texture_builder_set_display (builder, gdk_gl_context_get_display (self->gdk_context));
+    *pixel_aspect_ratio = ((double) GST_VIDEO_INFO_PAR_N (&self->v_info) /
+                           (double) GST_VIDEO_INFO_PAR_D (&self->v_info));
+
+    /*
+     * The same buffer got pushed again (e.g. a still image) and we held
+     * on to it since so the import can be reused. Pooled buffers that
+     * come back from the decoder have new contents and need a new
+     * texture as GTK treats textures as immutable.
+     */
+    if (buffer == self->dmabuf_buffer) {
+      *frame_release = (GDestroyNotify) gst_buffer_unref;
+      *frame_data = gst_buffer_ref (buffer);
+      return g_object_ref (self->dmabuf_texture);
+    }
+
+    if (self->dmabuf_builder == NULL)
+      self->dmabuf_builder = gdk_dmabuf_texture_builder_new ();
+    builder = self->dmabuf_builder;
+
+    gdk_dmabuf_texture_builder_set_display (builder, self->display);
     gdk_dmabuf_texture_builder_set_fourcc (builder, self->drm_info.drm_fourcc);
     gdk_dmabuf_texture_builder_set_modifier (builder, self->drm_info.drm_modifier);
     gdk_dmabuf_texture_builder_set_width (builder, vmeta->width);
     gdk_dmabuf_texture_builder_set_height (builder, vmeta->height);
     gdk_dmabuf_texture_builder_set_n_planes (builder, vmeta->n_planes);
+    if (self->color_state)
+      gdk_dmabuf_texture_builder_set_color_state (builder, self->color_state);
 
    for (i = 0; i < vmeta->n_planes; i++) {
         GstMemory *mem;
@@ -377,70 +1013,282 @@ livi_gst_sink_texture_from_buffer (LiviGstSink     *self,
         gdk_dmabuf_texture_builder_set_stride (builder, i, vmeta->stride[i]);
     }
 
-    texture = gdk_dmabuf_texture_builder_build (builder,
-                                                (GDestroyNotify) gst_buffer_unref,
-                                                gst_buffer_ref (buffer),
-                                                &error);
-    if (!texture)
+    /* Let GTK know the new frame replaces the previous one */
+    if (self->dmabuf_texture &&
+        gdk_texture_get_width (self->dmabuf_texture) == vmeta->width &&
+        gdk_texture_get_height (self->dmabuf_texture) == vmeta->height) {
+      cairo_region_t *region;
+
+      region = cairo_region_create_rectangle (&(cairo_rectangle_int_t) {
+          0, 0, vmeta->width, vmeta->height });
+      gdk_dmabuf_texture_builder_set_update_texture (builder, self->dmabuf_texture);
+      gdk_dmabuf_texture_builder_set_update_region (builder, region);
+      cairo_region_destroy (region);
+    }
+
+    texture = gdk_dmabuf_texture_builder_build (builder, NULL, NULL, &error);
+    /* Don't keep the previous frame alive via the builder */
+    gdk_dmabuf_texture_builder_set_update_texture (builder, NULL);
+    gdk_dmabuf_texture_builder_set_update_region (builder, NULL);
+    if (!texture) {
       GST_ERROR_OBJECT (self, "Failed to create dmabuf texture: %s", error->message);
+      g_clear_error (&error);
+      return NULL;
+    }
 
-    *pixel_aspect_ratio = ((double) GST_VIDEO_INFO_PAR_N (&self->v_info) /
-                           (double) GST_VIDEO_INFO_PAR_D (&self->v_info));
+    gst_buffer_replace (&self->dmabuf_buffer, buffer);
+    g_set_object (&self->dmabuf_texture, texture);
+    *frame_release = (GDestroyNotify) gst_buffer_unref;
+    *frame_data = gst_buffer_ref (buffer);
   } else
 #endif
-  if (self->gdk_context &&
+  if (self->gst_context &&
       gst_video_frame_map (frame, &self->v_info, buffer, GST_MAP_READ | GST_MAP_GL)) {
-    g_autoptr (GdkGLTextureBuilder) builder = NULL;
+    GdkGLTextureBuilder *builder;
     GstGLSyncMeta *sync_meta;
+    guint tex_id = *(guint *) frame->data[0];
 
     sync_meta = gst_buffer_get_gl_sync_meta (buffer);
     if (sync_meta)
       gst_gl_sync_meta_set_sync_point (sync_meta, self->gst_context);
 
-    builder = gdk_gl_texture_builder_new ();
+    *pixel_aspect_ratio = ((double) frame->info.par_n) / ((double) frame->info.par_d);
+    *frame_release = (GDestroyNotify) video_frame_free;
+    *frame_data = slot;
+
+    if (self->gl_builder == NULL)
+      self->gl_builder = gdk_gl_texture_builder_new ();
+    builder = self->gl_builder;
+
     gdk_gl_texture_builder_set_context (builder, self->gdk_context);
     gdk_gl_texture_builder_set_format (builder, livi_gst_memory_format_from_video_info (&frame->info));
-    gdk_gl_texture_builder_set_id (builder, *(guint *) frame->data[0]);
+    gdk_gl_texture_builder_set_id (builder, tex_id);
     gdk_gl_texture_builder_set_width (builder, frame->info.width);
     gdk_gl_texture_builder_set_height (builder, frame->info.height);
     gdk_gl_texture_builder_set_sync (builder, sync_meta ? sync_meta->data : NULL);
-
-    texture = gdk_gl_texture_builder_build (builder,
-                                            (GDestroyNotify) video_frame_free,
-                                            frame);
-
-    *pixel_aspect_ratio = ((double) frame->info.par_n) / ((double) frame->info.par_d);
+    if (self->color_state)
+      gdk_gl_texture_builder_set_color_state (builder, self->color_state);
+
+    texture = gdk_gl_texture_builder_build (builder, NULL, NULL);
+#if GTK_CHECK_VERSION (4, 20, 0)
+  } else if (GST_VIDEO_INFO_N_PLANES (&self->v_info) > 1) {
+    texture = livi_gst_sink_planar_texture_from_buffer (self, slot, buffer);
+    if (texture) {
+      *pixel_aspect_ratio = ((double) GST_VIDEO_INFO_PAR_N (&self->v_info) /
+                             (double) GST_VIDEO_INFO_PAR_D (&self->v_info));
+    } else {
+      GST_ERROR_OBJECT (self, "Could not map planar buffer.");
+      frame_slot_release (slot);
+    }
+#endif
   } else if (gst_video_frame_map (frame, &self->v_info, buffer, GST_MAP_READ)) {
-    g_autoptr (GBytes) bytes = NULL;
-
-    bytes = g_bytes_new_with_free_func (frame->data[0],
-                                        frame->info.height * frame->info.stride[0],
-                                        (GDestroyNotify) video_frame_free,
-                                        frame);
-    texture = gdk_memory_texture_new (frame->info.width,
-                                      frame->info.height,
-                                      livi_gst_memory_format_from_video_info (&frame->info),
-                                      bytes,
-                                      frame->info.stride[0]);
-
+    texture = livi_gst_sink_memory_texture_from_frame (self, slot, buffer);
     *pixel_aspect_ratio = ((double) frame->info.par_n) / ((double) frame->info.par_d);
   } else {
     GST_ERROR_OBJECT (self, "Could not convert buffer to texture.");
     texture = NULL;
-    g_free (frame);
+    frame_slot_release (slot);
   }
 
   return texture;
 }
 
+static void
+on_target_size_changed (LiviGstPaintable *paintable,
+                        int               width,
+                        int               height,
+                        LiviGstSink      *self)
+{
+  GST_DEBUG_OBJECT (self, "Target size %dx%d", width, height);
+
+  GST_OBJECT_LOCK (self);
+  self->target_width = width;
+  self->target_height = height;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_pad_push_event (GST_BASE_SINK_PAD (self), gst_event_new_reconfigure ());
+}
+
+static void
+on_held_frames_changed (LiviGstPaintable *paintable,
+                        GParamSpec       *pspec,
+                        LiviGstSink      *self)
+{
+  guint held_buffers = livi_gst_paintable_get_held_frames (paintable);
+
+  GST_DEBUG_OBJECT (self, "%u frames held outside the paintable", held_buffers);
+
+  GST_OBJECT_LOCK (self);
+  self->held_buffers = held_buffers;
+  GST_OBJECT_UNLOCK (self);
+
+  /* Makes upstream redo the allocation query */
+  gst_pad_push_event (GST_BASE_SINK_PAD (self), gst_event_new_reconfigure ());
+}
+
+static void
+on_frame_presented (LiviGstPaintable *paintable,
+                    guint64           timestamp,
+                    gint64            lateness,
+                    LiviGstSink      *self)
+{
+  GstClockTime duration = 40 * GST_MSECOND;
+  gboolean reconfigure = FALSE, send_qos, was_late;
+  guint min_buffers;
+  double rate;
+
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp))
+    return;
+
+  if (GST_STATE (self) != GST_STATE_PLAYING)
+    return;
+
+  GST_OBJECT_LOCK (self);
+  if (GST_VIDEO_INFO_FPS_N (&self->v_info) > 0) {
+    duration = gst_util_uint64_scale_int (GST_SECOND,
+                                          GST_VIDEO_INFO_FPS_D (&self->v_info),
+                                          GST_VIDEO_INFO_FPS_N (&self->v_info));
+  }
+
+  /* Like basesink: average of how long a frame takes relative to its duration */
+  rate = (double) (duration + MAX (lateness, 0)) / (double) duration;
+  self->qos_proportion = (self->qos_proportion * 7.0 + rate) / 8.0;
+  rate = self->qos_proportion;
+
+  self->avg_latency = (self->avg_latency * 7 + MAX (lateness, 0)) / 8;
+  min_buffers = MIN_POOL_BUFFERS + (self->avg_latency + duration - 1) / duration;
+  min_buffers = MIN (min_buffers, MAX_POOL_BUFFERS);
+  /* Grow right away to avoid stalls but only shrink on larger changes */
+  if (min_buffers > self->pool_min_buffers || min_buffers + 2 <= self->pool_min_buffers) {
+    GST_DEBUG_OBJECT (self, "Latency %" GST_TIME_FORMAT ", adjusting pool from %u to %u buffers",
+                      GST_TIME_ARGS (self->avg_latency), self->pool_min_buffers, min_buffers);
+    self->pool_min_buffers = min_buffers;
+    reconfigure = TRUE;
+  }
+
+  /* Only tell upstream about frames that missed their slot and once they're in time again */
+  was_late = self->qos_late;
+  self->qos_late = lateness > 0;
+  send_qos = self->qos_late || was_late;
+  GST_OBJECT_UNLOCK (self);
+
+  /* Makes upstream redo the allocation query */
+  if (reconfigure)
+    gst_pad_push_event (GST_BASE_SINK_PAD (self), gst_event_new_reconfigure ());
+
+  GST_LOG_OBJECT (self, "Frame %" GST_TIME_FORMAT " presented, lateness %" G_GINT64_FORMAT
+                  ", proportion %f", GST_TIME_ARGS (timestamp), lateness, rate);
+
+  if (send_qos) {
+    gst_pad_push_event (GST_BASE_SINK_PAD (self),
+                        gst_event_new_qos (lateness > 0 ? GST_QOS_TYPE_UNDERFLOW : GST_QOS_TYPE_OVERFLOW,
+                                           rate, lateness, timestamp));
+  }
+}
+
+static LiviGstOverlay *
+livi_gst_sink_overlay_from_rectangle (LiviGstSink                *self,
+                                      GstVideoOverlayRectangle   *rectangle)
+{
+  g_autoptr (GBytes) bytes = NULL;
+  LiviGstOverlay *overlay;
+  GstVideoMeta *vmeta;
+  GstBuffer *pixels;
+  GstMapInfo map;
+  guint seqnum = gst_video_overlay_rectangle_get_seqnum (rectangle);
+  int x, y;
+  guint width, height;
+
+  gst_video_overlay_rectangle_get_render_rectangle (rectangle, &x, &y, &width, &height);
+
+  /* Rectangles often carry over to the next composition */
+  for (guint i = 0; self->overlays && i < self->overlays->len; i++) {
+    LiviGstOverlay *cached = g_ptr_array_index (self->overlays, i);
+
+    if (cached->seqnum != seqnum)
+      continue;
+
+    overlay = g_new0 (LiviGstOverlay, 1);
+    overlay->texture = g_object_ref (cached->texture);
+    overlay->bounds = GRAPHENE_RECT_INIT (x, y, width, height);
+    overlay->seqnum = seqnum;
+    return overlay;
+  }
+
+  /* That's GDK's default format: BGRA on little and ARGB on big endian */
+  pixels = gst_video_overlay_rectangle_get_pixels_unscaled_argb (rectangle,
+                                                                 GST_VIDEO_OVERLAY_FORMAT_FLAG_PREMULTIPLIED_ALPHA);
+  vmeta = gst_buffer_get_video_meta (pixels);
+  if (vmeta == NULL || !gst_buffer_map (pixels, &map, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (self, "Can't map overlay rectangle");
+    return NULL;
+  }
+  bytes = g_bytes_new (map.data, map.size);
+  gst_buffer_unmap (pixels, &map);
+
+  overlay = g_new0 (LiviGstOverlay, 1);
+  overlay->texture = gdk_memory_texture_new (vmeta->width, vmeta->height,
+                                             GDK_MEMORY_DEFAULT,
+                                             bytes,
+                                             vmeta->stride[0]);
+  overlay->bounds = GRAPHENE_RECT_INIT (x, y, width, height);
+  overlay->seqnum = seqnum;
+
+  return overlay;
+}
+
+/*
+ * Returns: (transfer full)(nullable): The overlays to draw on top of
+ *   the frame.
+ */
+static GPtrArray *
+livi_gst_sink_overlays_from_buffer (LiviGstSink *self,
+                                    GstBuffer   *buffer)
+{
+  GstVideoOverlayCompositionMeta *meta;
+  GstVideoOverlayComposition *composition;
+  GPtrArray *overlays;
+  guint seqnum;
+
+  meta = gst_buffer_get_video_overlay_composition_meta (buffer);
+  if (meta == NULL) {
+    g_clear_pointer (&self->overlays, g_ptr_array_unref);
+    return NULL;
+  }
+
+  composition = meta->overlay;
+  seqnum = gst_video_overlay_composition_get_seqnum (composition);
+  if (self->overlays && self->overlays_seqnum == seqnum)
+    return g_ptr_array_ref (self->overlays);
+
+  overlays = g_ptr_array_new_with_free_func ((GDestroyNotify) livi_gst_overlay_free);
+  for (guint i = 0; i < gst_video_overlay_composition_n_rectangles (composition); i++) {
+    GstVideoOverlayRectangle *rectangle = gst_video_overlay_composition_get_rectangle (composition, i);
+    LiviGstOverlay *overlay = livi_gst_sink_overlay_from_rectangle (self, rectangle);
+
+    if (overlay)
+      g_ptr_array_add (overlays, overlay);
+  }
+
+  g_clear_pointer (&self->overlays, g_ptr_array_unref);
+  self->overlays = g_ptr_array_ref (overlays);
+  self->overlays_seqnum = seqnum;
+
+  return overlays;
+}
+
 static GstFlowReturn
 livi_gst_sink_show_frame (GstVideoSink *vsink,
                           GstBuffer    *buf)
 {
   LiviGstSink *self;
   g_autoptr (GdkTexture) texture = NULL;
+  g_autoptr (GPtrArray) overlays = NULL;
   double pixel_aspect_ratio;
   graphene_rect_t viewport;
+  GstClockTime running_time;
+  GDestroyNotify frame_release;
+  gpointer frame_data;
 
   GST_TRACE ("rendering buffer:%p", buf);
 
@@ -448,9 +1296,19 @@ livi_gst_sink_show_frame (GstVideoSink *vsink,
 
   GST_OBJECT_LOCK (self);
 
-  texture = livi_gst_sink_texture_from_buffer (self, buf, &pixel_aspect_ratio, &viewport);
-  if (texture)
-    livi_gst_paintable_queue_set_texture (self->paintable, texture, pixel_aspect_ratio, &viewport);
+  running_time = gst_segment_to_running_time (&GST_BASE_SINK (self)->segment,
+                                              GST_FORMAT_TIME,
+                                              GST_BUFFER_PTS (buf));
+
+  texture = livi_gst_sink_texture_from_buffer (self, buf, &pixel_aspect_ratio, &viewport,
+                                               &frame_release, &frame_data);
+  if (texture) {
+    overlays = livi_gst_sink_overlays_from_buffer (self, buf);
+    livi_gst_paintable_queue_set_texture (self->paintable, texture, pixel_aspect_ratio, &viewport,
+                                          running_time, overlays, frame_release, frame_data);
+  } else if (frame_release) {
+    frame_release (frame_data);
+  }
 
   GST_OBJECT_UNLOCK (self);
 
@@ -461,15 +1319,180 @@ livi_gst_sink_show_frame (GstVideoSink *vsink,
 #define DEACTIVATE_WGL_CONTEXT(ctx)
 #define REACTIVATE_WGL_CONTEXT(ctx)
 
+static void
+livi_gst_sink_create_gl_context_thread (GTask        *task,
+                                        gpointer      source_object,
+                                        gpointer      task_data,
+                                        GCancellable *cancellable)
+{
+  LiviGstSink *self = LIVI_GST_SINK (source_object);
+  GstGLContext *context = NULL;
+  g_autoptr (GError) error = NULL;
+  gboolean succeeded;
+
+  succeeded = gst_gl_display_create_context (self->gst_display, self->gst_app_context, &context, &error);
+  if (!succeeded)
+    GST_ERROR_OBJECT (self, "Couldn't create GL context: %s", error->message);
+  else
+    GST_DEBUG_OBJECT (self, "GL context created");
+
+  GST_OBJECT_LOCK (self);
+  self->gst_context = context;
+  self->gl_state = succeeded ? LIVI_GL_STATE_READY : LIVI_GL_STATE_FAILED;
+  g_cond_broadcast (&self->gl_cond);
+  GST_OBJECT_UNLOCK (self);
+
+  g_task_return_boolean (task, succeeded);
+}
+
+/*
+ * Drops the GL state if creating the context failed. Must be called with
+ * the object lock held once creation finished.
+ */
+static gboolean
+livi_gst_sink_settle_gl_locked (LiviGstSink *self)
+{
+  if (self->gl_state == LIVI_GL_STATE_FAILED) {
+    GST_WARNING_OBJECT (self, "No GL context, falling back to dmabufs and system memory");
+    g_clear_object (&self->gst_app_context);
+    g_clear_object (&self->gst_display);
+    g_clear_object (&self->gdk_context);
+    self->gl_state = LIVI_GL_STATE_NONE;
+  }
+
+  return self->gl_state == LIVI_GL_STATE_READY;
+}
+
+/* Wait for the GL context creation to finish. Must be called with the object lock held. */
+static gboolean
+livi_gst_sink_wait_gl_locked (LiviGstSink *self)
+{
+  /* The main thread might be what's needed to make progress */
+  if (g_main_context_is_owner (g_main_context_default ()))
+    return self->gl_state == LIVI_GL_STATE_READY;
+
+  while (self->gl_state == LIVI_GL_STATE_PENDING)
+    g_cond_wait (&self->gl_cond, GST_OBJECT_GET_LOCK (self));
+
+  return self->gl_state == LIVI_GL_STATE_READY;
+}
+
+/**
+ * livi_gst_sink_wait_gl:
+ * @self: The sink
+ *
+ * Waits for the GL context creation to finish. If it failed the GL state
+ * is dropped so the sink only offers dmabufs and system memory. This
+ * doesn't block once livi_gst_sink_wait_gl_async() completed.
+ *
+ * Returns: %TRUE if the sink can consume GL memory
+ */
+gboolean
+livi_gst_sink_wait_gl (LiviGstSink *self)
+{
+  gboolean have_gl;
+
+  g_return_val_if_fail (LIVI_IS_GST_SINK (self), FALSE);
+
+  GST_OBJECT_LOCK (self);
+  while (self->gl_state == LIVI_GL_STATE_PENDING)
+    g_cond_wait (&self->gl_cond, GST_OBJECT_GET_LOCK (self));
+
+  have_gl = livi_gst_sink_settle_gl_locked (self);
+  GST_OBJECT_UNLOCK (self);
+
+  return have_gl;
+}
+
+/**
+ * livi_gst_sink_wait_gl_async:
+ * @self: The sink
+ * @cancellable:(nullable): A cancellable
+ * @callback: Called on the main thread once GL context creation finished
+ * @user_data: The data passed to @callback
+ *
+ * Like livi_gst_sink_wait_gl() but doesn't block the main thread.
+ */
+void
+livi_gst_sink_wait_gl_async (LiviGstSink         *self,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  gboolean have_gl;
+
+  g_return_if_fail (LIVI_IS_GST_SINK (self));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, livi_gst_sink_wait_gl_async);
+
+  GST_OBJECT_LOCK (self);
+  if (self->gl_state == LIVI_GL_STATE_PENDING) {
+    if (self->gl_waiters == NULL)
+      self->gl_waiters = g_ptr_array_new_with_free_func (g_object_unref);
+    g_ptr_array_add (self->gl_waiters, g_steal_pointer (&task));
+    GST_OBJECT_UNLOCK (self);
+    return;
+  }
+  have_gl = livi_gst_sink_settle_gl_locked (self);
+  GST_OBJECT_UNLOCK (self);
+
+  g_task_return_boolean (task, have_gl);
+}
+
+/**
+ * livi_gst_sink_wait_gl_finish:
+ * @self: The sink
+ * @res: The result
+ * @error: The return location for an error
+ *
+ * Returns: %TRUE if the sink can consume GL memory, %FALSE if it can't
+ *   or on error
+ */
+gboolean
+livi_gst_sink_wait_gl_finish (LiviGstSink   *self,
+                              GAsyncResult  *res,
+                              GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static void
+on_gl_context_created (GObject      *source_object,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  LiviGstSink *self = LIVI_GST_SINK (source_object);
+  g_autoptr (GPtrArray) waiters = NULL;
+  gboolean have_gl;
+
+  GST_OBJECT_LOCK (self);
+  have_gl = livi_gst_sink_settle_gl_locked (self);
+  waiters = g_steal_pointer (&self->gl_waiters);
+  GST_OBJECT_UNLOCK (self);
+
+  for (guint i = 0; waiters && i < waiters->len; i++)
+    g_task_return_boolean (g_ptr_array_index (waiters, i), have_gl);
+}
+
+/*
+ * Wrapping GDK's context needs it to be current so happens right away
+ * but creating GStreamer's GL context (which spawns its own thread) is
+ * done in a worker. Its outcome is only needed once the sink chain gets
+ * built, see livi_gst_sink_wait_gl_async().
+ */
 static gboolean
 livi_gst_sink_initialize_gl (LiviGstSink *self)
 {
+  g_autoptr (GTask) task = NULL;
   GdkDisplay *display;
   GError *error = NULL;
   GstGLPlatform platform = GST_GL_PLATFORM_NONE;
   GstGLAPI gl_api = GST_GL_API_NONE;
   guintptr gl_handle = 0;
-  gboolean succeeded = FALSE;
 
   display = gdk_gl_context_get_display (self->gdk_context);
 
@@ -515,18 +1538,15 @@ livi_gst_sink_initialize_gl (LiviGstSink *self)
     gst_gl_context_activate (self->gst_app_context, FALSE);
   }
 
-  succeeded = gst_gl_display_create_context (self->gst_display, self->gst_app_context, &self->gst_context, &error);
-
-  if (!succeeded) {
-    GST_ERROR_OBJECT (self, "Couldn't create GL context: %s", error->message);
-    g_error_free (error);
-    g_clear_object (&self->gst_app_context);
-    g_clear_object (&self->gst_display);
-  }
-
   HANDLE_EXTERNAL_WGL_MAKE_CURRENT (self->gdk_context);
   REACTIVATE_WGL_CONTEXT (self->gdk_context);
-  return succeeded;
+
+  self->gl_state = LIVI_GL_STATE_PENDING;
+  task = g_task_new (self, NULL, on_gl_context_created, NULL);
+  g_task_set_source_tag (task, livi_gst_sink_initialize_gl);
+  g_task_run_in_thread (task, livi_gst_sink_create_gl_context_thread);
+
+  return TRUE;
 }
 
 static void
@@ -543,10 +1563,19 @@ livi_gst_sink_set_property (GObject      *object,
     self->paintable = g_value_dup_object (value);
     if (self->paintable == NULL)
       self->paintable = LIVI_GST_PAINTABLE (livi_gst_paintable_new ());
+    g_signal_connect_object (self->paintable, "frame-presented",
+                             G_CALLBACK (on_frame_presented), self, 0);
+    g_signal_connect_object (self->paintable, "target-size-changed",
+                             G_CALLBACK (on_target_size_changed), self, 0);
+    g_signal_connect_object (self->paintable, "notify::held-frames",
+                             G_CALLBACK (on_held_frames_changed), self, 0);
+    self->held_buffers = livi_gst_paintable_get_held_frames (self->paintable);
     break;
 
   case PROP_GL_CONTEXT:
     self->gdk_context = g_value_dup_object (value);
+    if (self->gdk_context != NULL)
+      g_set_object (&self->display, gdk_gl_context_get_display (self->gdk_context));
     if (self->gdk_context != NULL && !livi_gst_sink_initialize_gl (self))
       g_clear_object (&self->gdk_context);
     break;
@@ -583,13 +1612,36 @@ livi_gst_sink_dispose (GObject *object)
   LiviGstSink *self = LIVI_GST_SINK (object);
 
   g_clear_object (&self->paintable);
+  dmabuf_texture_clear (self);
+  g_clear_object (&self->gl_builder);
+  g_clear_object (&self->memory_builder);
+  damage_clear (self);
+  g_clear_pointer (&self->overlays, g_ptr_array_unref);
+  g_clear_pointer (&self->color_state, gdk_color_state_unref);
+#ifdef HAVE_GSTREAMER_DRM
+  g_clear_object (&self->dmabuf_builder);
+#endif
+  g_clear_pointer (&self->frame_pool, g_atomic_rc_box_release);
+  g_clear_object (&self->gst_context);
   g_clear_object (&self->gst_app_context);
   g_clear_object (&self->gst_display);
   g_clear_object (&self->gdk_context);
+  g_clear_object (&self->display);
 
   G_OBJECT_CLASS (livi_gst_sink_parent_class)->dispose (object);
 }
 
+
+static void
+livi_gst_sink_finalize (GObject *object)
+{
+  LiviGstSink *self = LIVI_GST_SINK (object);
+
+  g_cond_clear (&self->gl_cond);
+
+  G_OBJECT_CLASS (livi_gst_sink_parent_class)->finalize (object);
+}
+
 static void
 livi_gst_sink_class_init (LiviGstSinkClass * klass)
 {
@@ -601,10 +1653,13 @@ livi_gst_sink_class_init (LiviGstSinkClass * klass)
   gobject_class->set_property = livi_gst_sink_set_property;
   gobject_class->get_property = livi_gst_sink_get_property;
   gobject_class->dispose = livi_gst_sink_dispose;
+  gobject_class->finalize = livi_gst_sink_finalize;
 
   gstbasesink_class->set_caps = livi_gst_sink_set_caps;
   gstbasesink_class->get_times = livi_gst_sink_get_times;
   gstbasesink_class->query = livi_gst_sink_query;
+  gstbasesink_class->event = livi_gst_sink_event;
+  gstbasesink_class->stop = livi_gst_sink_stop;
   gstbasesink_class->propose_allocation = livi_gst_sink_propose_allocation;
   gstbasesink_class->get_caps = livi_gst_sink_get_caps;
 
@@ -649,4 +1704,14 @@ livi_gst_sink_class_init (LiviGstSinkClass * klass)
 static void
 livi_gst_sink_init (LiviGstSink *self)
 {
+  self->frame_pool = g_atomic_rc_box_new0 (LiviFramePool);
+  g_cond_init (&self->gl_cond);
+  /* Overridden by the GL context's display if there is one */
+  g_set_object (&self->display, gdk_display_get_default ());
+  self->qos_proportion = 1.0;
+  self->pool_min_buffers = MIN_POOL_BUFFERS;
+  self->damage_pts = GST_CLOCK_TIME_NONE;
+
+  /* QoS is sent based on the actual presentation time instead, see on_frame_presented () */
+  gst_base_sink_set_qos_enabled (GST_BASE_SINK (self), FALSE);
 }
@@ -20,4 +20,13 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (LiviGstSink, livi_gst_sink, LIVI, GST_SINK, GstVideoSink)
 
+gboolean livi_gst_sink_wait_gl        (LiviGstSink         *self);
+void     livi_gst_sink_wait_gl_async  (LiviGstSink         *self,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data);
+gboolean livi_gst_sink_wait_gl_finish (LiviGstSink         *self,
+                                       GAsyncResult        *res,
+                                       GError             **error);
+
 G_END_DECLS
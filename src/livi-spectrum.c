@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2024 Guido Günther <agx@sigxcpu.org>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Author: Guido Günther <agx@sigxcpu.org>
+ */
+
+#define G_LOG_DOMAIN "livi-spectrum"
+
+#include "livi-config.h"
+
+#include "livi-spectrum.h"
+
+/**
+ * LiviSpectrum:
+ *
+ * Draws the band magnitudes of an audio spectrum as bars. The
+ * magnitudes arrive at a low rate, the bars are animated towards
+ * them on the frame clock.
+ */
+
+/* Magnitudes at or below this are drawn as empty bars */
+#define MIN_DB         -60.0
+/* Let bars fall when no new magnitudes arrived for this long */
+#define STALE_US       (250 * G_TIME_SPAN_MILLISECOND)
+#define BAR_SPACING    0.25
+#define MAX_HEIGHT     0.5
+
+struct _LiviSpectrum {
+  GtkWidget             parent;
+
+  GArray               *target;
+  GArray               *current;
+  gint64                last_update;
+  gint64                last_frame;
+  guint                 tick_id;
+};
+G_DEFINE_TYPE (LiviSpectrum, livi_spectrum, GTK_TYPE_WIDGET)
+
+
+static gboolean
+on_tick (GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
+{
+  LiviSpectrum *self = LIVI_SPECTRUM (widget);
+  gint64 now = gdk_frame_clock_get_frame_time (frame_clock);
+  gboolean stale = now - self->last_update > STALE_US;
+  gboolean settled = TRUE;
+  double rise, fall;
+
+  /* Frame rate independent smoothing: bars rise fast and fall slowly */
+  if (self->last_frame) {
+    double dt = (now - self->last_frame) / (double) G_USEC_PER_SEC;
+
+    rise = MIN (1.0, dt * 20.0);
+    fall = MIN (1.0, dt * 4.0);
+  } else {
+    rise = fall = 1.0;
+  }
+  self->last_frame = now;
+
+  for (guint i = 0; i < self->current->len; i++) {
+    float target = stale ? 0.0 : g_array_index (self->target, float, i);
+    float *current = &g_array_index (self->current, float, i);
+    double factor = target > *current ? rise : fall;
+
+    *current += (target - *current) * factor;
+    if (!G_APPROX_VALUE (*current, target, 0.001))
+      settled = FALSE;
+  }
+
+  gtk_widget_queue_draw (widget);
+
+  if (settled && stale) {
+    self->tick_id = 0;
+    self->last_frame = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+livi_spectrum_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
+{
+  LiviSpectrum *self = LIVI_SPECTRUM (widget);
+  int width = gtk_widget_get_width (widget);
+  int height = gtk_widget_get_height (widget);
+  float bar_width;
+  GdkRGBA color;
+
+  if (self->current->len == 0)
+    return;
+
+  gtk_widget_get_color (widget, &color);
+  bar_width = width / (self->current->len + (self->current->len + 1) * BAR_SPACING);
+
+  for (guint i = 0; i < self->current->len; i++) {
+    float value = g_array_index (self->current, float, i);
+    float bar_height = value * height * MAX_HEIGHT;
+    graphene_rect_t bar;
+
+    if (bar_height < 1.0)
+      continue;
+
+    bar = GRAPHENE_RECT_INIT ((i + 1) * BAR_SPACING * bar_width + i * bar_width,
+                              height - bar_height,
+                              bar_width,
+                              bar_height);
+    gtk_snapshot_append_color (snapshot, &color, &bar);
+  }
+}
+
+
+static void
+livi_spectrum_unmap (GtkWidget *widget)
+{
+  LiviSpectrum *self = LIVI_SPECTRUM (widget);
+
+  if (self->tick_id) {
+    gtk_widget_remove_tick_callback (widget, self->tick_id);
+    self->tick_id = 0;
+    self->last_frame = 0;
+  }
+
+  GTK_WIDGET_CLASS (livi_spectrum_parent_class)->unmap (widget);
+}
+
+
+static void
+livi_spectrum_finalize (GObject *object)
+{
+  LiviSpectrum *self = LIVI_SPECTRUM (object);
+
+  g_clear_pointer (&self->target, g_array_unref);
+  g_clear_pointer (&self->current, g_array_unref);
+
+  G_OBJECT_CLASS (livi_spectrum_parent_class)->finalize (object);
+}
+
+
+static void
+livi_spectrum_class_init (LiviSpectrumClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->finalize = livi_spectrum_finalize;
+
+  widget_class->snapshot = livi_spectrum_snapshot;
+  widget_class->unmap = livi_spectrum_unmap;
+
+  gtk_widget_class_set_css_name (widget_class, "livi-spectrum");
+}
+
+
+static void
+livi_spectrum_init (LiviSpectrum *self)
+{
+  self->target = g_array_new (FALSE, TRUE, sizeof (float));
+  self->current = g_array_new (FALSE, TRUE, sizeof (float));
+}
+
+
+LiviSpectrum *
+livi_spectrum_new (void)
+{
+  return g_object_new (LIVI_TYPE_SPECTRUM, NULL);
+}
+
+/**
+ * livi_spectrum_set_magnitudes:
+ * @self: The spectrum
+ * @magnitudes: (array length=n_bands): The band magnitudes in dB
+ * @n_bands: The number of bands
+ *
+ * Sets the magnitudes the bars animate to.
+ */
+void
+livi_spectrum_set_magnitudes (LiviSpectrum *self, const float *magnitudes, guint n_bands)
+{
+  g_return_if_fail (LIVI_IS_SPECTRUM (self));
+
+  if (n_bands != self->target->len) {
+    g_array_set_size (self->target, n_bands);
+    g_array_set_size (self->current, n_bands);
+  }
+
+  for (guint i = 0; i < n_bands; i++) {
+    float value = (CLAMP (magnitudes[i], MIN_DB, 0.0) - MIN_DB) / -MIN_DB;
+
+    g_array_index (self->target, float, i) = value;
+  }
+
+  self->last_update = g_get_monotonic_time ();
+  if (self->tick_id == 0 && gtk_widget_get_mapped (GTK_WIDGET (self)))
+    self->tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (self), on_tick, NULL, NULL);
+}
+
+/**
+ * livi_spectrum_clear:
+ * @self: The spectrum
+ *
+ * Removes all bars.
+ */
+void
+livi_spectrum_clear (LiviSpectrum *self)
+{
+  g_return_if_fail (LIVI_IS_SPECTRUM (self));
+
+  if (self->tick_id) {
+    gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick_id);
+    self->tick_id = 0;
+    self->last_frame = 0;
+  }
+
+  g_array_set_size (self->target, 0);
+  g_array_set_size (self->current, 0);
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
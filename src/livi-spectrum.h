@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2024 Guido Günther <agx@sigxcpu.org>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define LIVI_TYPE_SPECTRUM (livi_spectrum_get_type ())
+
+G_DECLARE_FINAL_TYPE (LiviSpectrum, livi_spectrum, LIVI, SPECTRUM, GtkWidget)
+
+LiviSpectrum *livi_spectrum_new (void);
+void          livi_spectrum_set_magnitudes (LiviSpectrum *self,
+                                            const float  *magnitudes,
+                                            guint         n_bands);
+void          livi_spectrum_clear (LiviSpectrum *self);
+
+G_END_DECLS
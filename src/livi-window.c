@@ -13,12 +13,16 @@
 #include "livi-config.h"
 #include "livi-application.h"
 #include "livi-controls.h"
+#include "livi-frame-cache.h"
 #include "livi-recent-videos.h"
+#include "livi-spectrum.h"
 #include "livi-window.h"
 #include "livi-utils.h"
 #include "livi-gst-paintable.h"
 
 #include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
 #include <gst/play/gstplay.h>
 #include <gst/play/gstplay-visualization.h>
 #include <gst/play/gstplay-signal-adapter.h>
@@ -27,10 +31,17 @@
 #include <adwaita.h>
 #include <glib/gi18n.h>
 
+#include <math.h>
+
+#ifdef HAVE_GSTREAMER_DRM
+#include <drm_fourcc.h>
+#endif
+
 enum {
   PROP_0,
   PROP_MUTED,
   PROP_PLAYBACK_SPEED,
+  PROP_INSTANT_RATE,
   PROP_STATE,
   PROP_TITLE,
   PROP_DURATION,
@@ -77,11 +88,33 @@ struct _LiviWindow
   GtkButton            *btn_resume;
   guint                 reveal_id;
 
+  GtkLabel             *lbl_subtitle;
+  guint                 subtitle_hide_id;
+  /* The cue's remaining display time in µs, only runs down while playing */
+  gint64                subtitle_remaining;
+  gint64                subtitle_hide_time;
+
+  LiviSpectrum         *spectrum;
+  GstElement           *spectrum_filter;
+
+  /* zoom and pan in normalized frame coordinates */
+  struct {
+    double              level;
+    double              cx, cy;
+    double              begin_level;
+    double              begin_cx, begin_cy;
+    double              pointer_x, pointer_y;
+  } zoom;
+
   AdwStatusPage        *error_state;
   GtkBox               *empty_state;
 
   GstPlay              *player;
   GstPlaySignalAdapter *signal_adapter;
+  /* What to do once the player got created */
+  GCancellable         *player_cancel;
+  char                 *pending_uri;
+  gboolean              pending_play;
   GstElement           *gtk4paintablesink;
   GstPlayState          state;
   guint                 cookie;
@@ -90,6 +123,10 @@ struct _LiviWindow
   struct {
     gboolean            muted;
     int                 playback_speed;
+    int                 trick_rate;
+    gboolean            rate_changed_instantly;
+    /* How the last rate change got applied, unlike the above kept after seeks */
+    gboolean            instant_rate;
     guint               num_audio_streams;
     guint               num_subtitle_streams;
     char               *title;
@@ -97,14 +134,36 @@ struct _LiviWindow
     gboolean            uri_preprocessed;
     GstClockTime        duration_ns;
     GstClockTime        position_ns;
+    GstClockTime        resume_ns;
   } stream;
 
   GtkFileFilter        *video_filter;
   char                 *last_local_uri;
 
   /* seeking */
-  gboolean              seek_lock;
   StreamTargetState     seek_target_state;
+  struct {
+    gboolean            active;
+    gboolean            in_flight;
+    gboolean            pending;
+    gboolean            accurate;
+    GstClockTime        target;
+    gint64              started;
+    guint               settle_id;
+  } seek;
+
+  /* frame stepping */
+  struct {
+    gboolean            active;
+    gboolean            busy;
+    gint64              busy_since;
+    gboolean            stepped;
+    gboolean            step_after_seek;
+    GstClockTime        pts;
+    GstClockTime        decoded_pts;
+    GstClockTime        fill_target;
+    LiviFrameCache     *cache;
+  } step;
 
   LiviRecentVideos     *recent_videos;
 
@@ -114,6 +173,9 @@ struct _LiviWindow
 
 G_DEFINE_TYPE (LiviWindow, livi_window, ADW_TYPE_APPLICATION_WINDOW)
 
+static gboolean set_trick_rate (LiviWindow *self, int rate);
+static void stop_stepping (LiviWindow *self);
+
 
 static void
 hide_controls (LiviWindow *self)
@@ -203,11 +265,185 @@ on_window_suspended (LiviWindow *self)
 
   if (self->num_video_streams)
     gst_play_set_video_track_enabled (self->player, !suspended);
+  else if (gtk_widget_get_visible (GTK_WIDGET (self->spectrum)))
+    g_object_set (self->spectrum_filter, "post-messages", !suspended, NULL);
   else
     gst_play_set_visualization_enabled (self->player, !suspended);
 }
 
 
+static void
+on_offloadable_changed (LiviWindow *self)
+{
+  gboolean offloadable = livi_gst_paintable_get_offloadable (LIVI_GST_PAINTABLE (self->paintable));
+
+  g_debug ("Video frames %s be offloaded to a subsurface", offloadable ? "can" : "can't");
+}
+
+
+#define MAX_ZOOM 8.0
+
+static void
+apply_zoom (LiviWindow *self)
+{
+  double half;
+
+  self->zoom.level = CLAMP (self->zoom.level, 1.0, MAX_ZOOM);
+  half = 0.5 / self->zoom.level;
+  self->zoom.cx = CLAMP (self->zoom.cx, half, 1.0 - half);
+  self->zoom.cy = CLAMP (self->zoom.cy, half, 1.0 - half);
+
+  if (!LIVI_IS_GST_PAINTABLE (self->paintable))
+    return;
+
+  livi_gst_paintable_set_zoom (LIVI_GST_PAINTABLE (self->paintable),
+                               &GRAPHENE_RECT_INIT (self->zoom.cx - half, self->zoom.cy - half,
+                                                    2 * half, 2 * half));
+}
+
+
+static void
+reset_zoom (LiviWindow *self)
+{
+  self->zoom.level = 1.0;
+  self->zoom.cx = 0.5;
+  self->zoom.cy = 0.5;
+  apply_zoom (self);
+}
+
+
+/* The part of the picture the video is drawn in */
+static void
+get_video_rect (LiviWindow *self, graphene_rect_t *rect)
+{
+  double width = gtk_widget_get_width (GTK_WIDGET (self->picture_video));
+  double height = gtk_widget_get_height (GTK_WIDGET (self->picture_video));
+  double ratio = self->paintable ? gdk_paintable_get_intrinsic_aspect_ratio (self->paintable) : 0.0;
+
+  *rect = GRAPHENE_RECT_INIT (0, 0, MAX (width, 1), MAX (height, 1));
+  if (ratio <= 0.0)
+    return;
+
+  if (width / height > ratio) {
+    rect->size.width = height * ratio;
+    rect->origin.x = (width - rect->size.width) / 2;
+  } else {
+    rect->size.height = width / ratio;
+    rect->origin.y = (height - rect->size.height) / 2;
+  }
+}
+
+
+/* Zoom to @level keeping the frame's content at @x, @y in place */
+static void
+zoom_at (LiviWindow *self, double level, double x, double y)
+{
+  graphene_rect_t rect;
+  double rx, ry, u, v, half;
+
+  get_video_rect (self, &rect);
+  rx = CLAMP ((x - rect.origin.x) / rect.size.width, 0.0, 1.0);
+  ry = CLAMP ((y - rect.origin.y) / rect.size.height, 0.0, 1.0);
+
+  half = 0.5 / self->zoom.level;
+  u = self->zoom.cx - half + rx * 2 * half;
+  v = self->zoom.cy - half + ry * 2 * half;
+
+  self->zoom.level = CLAMP (level, 1.0, MAX_ZOOM);
+  half = 0.5 / self->zoom.level;
+  self->zoom.cx = u - rx * 2 * half + half;
+  self->zoom.cy = v - ry * 2 * half + half;
+
+  apply_zoom (self);
+}
+
+
+static void
+on_zoom_begin (LiviWindow *self)
+{
+  self->zoom.begin_level = self->zoom.level;
+}
+
+
+static void
+on_zoom_scale_changed (LiviWindow *self, double scale, GtkGesture *gesture)
+{
+  double x, y;
+
+  if (!gtk_gesture_get_bounding_box_center (gesture, &x, &y))
+    return;
+
+  zoom_at (self, self->zoom.begin_level * scale, x, y);
+}
+
+
+static void
+on_pointer_motion_video (LiviWindow *self, double x, double y)
+{
+  self->zoom.pointer_x = x;
+  self->zoom.pointer_y = y;
+}
+
+
+static gboolean
+on_scroll (LiviWindow *self, double dx, double dy)
+{
+  zoom_at (self, self->zoom.level * pow (1.2, -dy), self->zoom.pointer_x, self->zoom.pointer_y);
+
+  return TRUE;
+}
+
+
+static void
+on_drag_begin (LiviWindow *self)
+{
+  self->zoom.begin_cx = self->zoom.cx;
+  self->zoom.begin_cy = self->zoom.cy;
+}
+
+
+static void
+on_drag_update (LiviWindow *self, double offset_x, double offset_y)
+{
+  graphene_rect_t rect;
+
+  if (self->zoom.level <= 1.0)
+    return;
+
+  get_video_rect (self, &rect);
+  self->zoom.cx = self->zoom.begin_cx - offset_x / (rect.size.width * self->zoom.level);
+  self->zoom.cy = self->zoom.begin_cy - offset_y / (rect.size.height * self->zoom.level);
+  apply_zoom (self);
+}
+
+
+static void
+add_zoom_and_pan (LiviWindow *self, GtkWidget *widget)
+{
+  GtkEventController *controller;
+  GtkGesture *gesture;
+
+  gesture = gtk_gesture_zoom_new ();
+  g_signal_connect_swapped (gesture, "begin", G_CALLBACK (on_zoom_begin), self);
+  g_signal_connect_object (gesture, "scale-changed", G_CALLBACK (on_zoom_scale_changed), self,
+                           G_CONNECT_SWAPPED);
+  gtk_widget_add_controller (widget, GTK_EVENT_CONTROLLER (gesture));
+
+  gesture = gtk_gesture_drag_new ();
+  g_signal_connect_swapped (gesture, "drag-begin", G_CALLBACK (on_drag_begin), self);
+  g_signal_connect_swapped (gesture, "drag-update", G_CALLBACK (on_drag_update), self);
+  gtk_widget_add_controller (widget, GTK_EVENT_CONTROLLER (gesture));
+
+  controller = gtk_event_controller_scroll_new (GTK_EVENT_CONTROLLER_SCROLL_VERTICAL);
+  g_signal_connect_swapped (controller, "scroll", G_CALLBACK (on_scroll), self);
+  gtk_widget_add_controller (widget, controller);
+
+  controller = gtk_event_controller_motion_new ();
+  g_signal_connect_swapped (controller, "motion", G_CALLBACK (on_pointer_motion_video), self);
+  gtk_widget_add_controller (widget, controller);
+}
+
+
 static void
 reset_stream (LiviWindow *self)
 {
@@ -217,25 +453,71 @@ reset_stream (LiviWindow *self)
   }
   memset (&self->stream, 0, sizeof (self->stream));
   self->stream.playback_speed = 100;
+  self->stream.resume_ns = GST_CLOCK_TIME_NONE;
 
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_TITLE]);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DURATION]);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_POSITION]);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_PLAYBACK_SPEED]);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTANT_RATE]);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_MUTED]);
 }
 
 
+/*
+ * Change the rate without flushing so there's no stall and network
+ * streams don't need to refill their buffers
+ */
+static gboolean
+set_rate_instantly (LiviWindow *self, double rate)
+{
+  g_autoptr (GstElement) pipeline = NULL;
+
+  if (self->state != GST_PLAY_STATE_PLAYING && self->state != GST_PLAY_STATE_PAUSED)
+    return FALSE;
+
+  pipeline = gst_play_get_pipeline (self->player);
+  return gst_element_seek (pipeline, rate, GST_FORMAT_TIME,
+                           GST_SEEK_FLAG_INSTANT_RATE_CHANGE,
+                           GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE,
+                           GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+}
+
+
 static void
 livi_window_set_playback_speed (LiviWindow *self, int percent)
 {
-  g_debug ("Setting Rate to : %f", percent / 100.0);
+  double rate = percent / 100.0;
 
-  if (percent == self->stream.playback_speed)
+  g_debug ("Setting Rate to : %f", rate);
+
+  if (percent == self->stream.playback_speed && !self->stream.trick_rate)
     return;
 
-  if (self->player)
-    gst_play_set_rate (self->player, percent / 100.0);
+  if (self->player) {
+    gboolean instant;
+
+    /* Leaving trick mode needs a flushing seek */
+    instant = !self->stream.trick_rate && set_rate_instantly (self, rate);
+    if (instant) {
+      g_debug ("Changed rate instantly");
+    } else {
+      g_debug ("Changed rate via flushing seek");
+      gst_play_set_rate (self->player, rate);
+    }
+    self->stream.rate_changed_instantly = instant;
+
+    if (self->stream.instant_rate != instant) {
+      self->stream.instant_rate = instant;
+      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTANT_RATE]);
+    }
+  }
+
+  /* Setting the rate ends trick mode too */
+  if (self->stream.trick_rate) {
+    self->stream.trick_rate = 0;
+    gtk_revealer_set_reveal_child (self->revealer_center, FALSE);
+  }
 
   self->stream.playback_speed = percent;
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_PLAYBACK_SPEED]);
@@ -284,6 +566,9 @@ livi_window_get_property (GObject    *object,
     case PROP_PLAYBACK_SPEED:
       g_value_set_int (value, self->stream.playback_speed);
       break;
+    case PROP_INSTANT_RATE:
+      g_value_set_boolean (value, self->stream.instant_rate);
+      break;
     case PROP_STATE:
       g_value_set_enum (value, self->state);
       break;
@@ -359,225 +644,1229 @@ show_center_overlay (LiviWindow *self, const char *icon_name, const char *label,
 }
 
 
-static void
-hide_center_overlay (LiviWindow *self)
-{
-  if (self->seek_lock)
-    return;
+static void
+hide_center_overlay (LiviWindow *self)
+{
+  if (self->seek.active || self->stream.trick_rate)
+    return;
+
+  gtk_revealer_set_reveal_child (self->revealer_center, FALSE);
+}
+
+
+static void
+show_resume_or_restart_overlay (LiviWindow *self, gboolean can_resume)
+{
+  gtk_widget_set_visible (GTK_WIDGET (self->btn_resume), can_resume);
+  gtk_stack_set_visible_child (self->stack_center, GTK_WIDGET (self->box_resume_or_restart));
+  gtk_revealer_set_reveal_child (self->revealer_center, TRUE);
+
+  self->seek_target_state = STREAM_TARGET_STATE_PREVIEW;
+}
+
+
+static void
+toggle_controls (LiviWindow *self)
+{
+  gboolean revealed;
+
+  g_assert (LIVI_IS_WINDOW (self));
+
+  revealed = adw_toolbar_view_get_reveal_bottom_bars (self->toolbar);
+
+  if (!revealed)
+    show_controls (self);
+  else
+    hide_controls (self);
+}
+
+
+static void
+on_toggle_controls_activated (GtkWidget  *widget, const char *action_name, GVariant *unused)
+{
+  toggle_controls (LIVI_WINDOW (widget));
+}
+
+
+static void
+on_toggle_play_activated (GtkWidget  *widget, const char *action_name, GVariant *unused)
+{
+  LiviWindow *self = LIVI_WINDOW (widget);
+  const char *icon_name;
+  gboolean fade;
+
+  if (self->stream.trick_rate && set_trick_rate (self, 0)) {
+    /* Continue at normal speed */
+    icon_name = "media-playback-start-symbolic";
+    fade = TRUE;
+  } else if (self->state == GST_PLAY_STATE_PLAYING) {
+    gst_play_pause (self->player);
+    icon_name = "media-playback-pause-symbolic";
+    fade = FALSE;
+  } else {
+    stop_stepping (self);
+    gst_play_play (self->player);
+    icon_name = "media-playback-start-symbolic";
+    fade = TRUE;
+  }
+
+  show_center_overlay (self, icon_name, NULL, fade);
+  gtk_stack_set_visible_child (self->stack_content, GTK_WIDGET (self->box_content));
+}
+
+
+/* Seek via the player keeping its idea of the rate up to date */
+static void
+player_seek (LiviWindow *self, GstClockTime pos)
+{
+  /* The player doesn't know about instant rate changes, the rate gets
+   * applied together with the seek */
+  if (self->stream.rate_changed_instantly) {
+    gst_play_set_rate (self->player, self->stream.playback_speed / 100.0);
+    self->stream.rate_changed_instantly = FALSE;
+  }
+
+  gst_play_seek (self->player, pos);
+}
+
+
+static void
+on_restart_activated (GtkWidget  *widget, const char *action_name, GVariant *unused)
+{
+  LiviWindow *self = LIVI_WINDOW (widget);
+
+  self->stream.resume_ns = GST_CLOCK_TIME_NONE;
+  self->seek_target_state = STREAM_TARGET_STATE_PLAY;
+  player_seek (self, 0);
+}
+
+
+typedef struct _LiviSnapshotData {
+  GstPlay               *player;
+  GstPlaySnapshotFormat  format;
+  char                  *dir;
+  char                  *name;
+  const char            *ext;
+  char                  *path;
+} LiviSnapshotData;
+
+
+static void
+snapshot_data_free (LiviSnapshotData *data)
+{
+  gst_object_unref (data->player);
+  g_free (data->dir);
+  g_free (data->name);
+  g_free (data->path);
+  g_free (data);
+}
+
+
+/* Don't try forever when the directory is full of snapshots of the same position */
+#define MAX_SNAPSHOT_SUFFIX 1000
+
+/*
+ * Writes the snapshot without replacing existing files by adding a
+ * number to the file name until it's unique
+ */
+static gboolean
+snapshot_write (LiviSnapshotData *data, GBytes *bytes, GCancellable *cancellable, GError **error)
+{
+  for (guint i = 0; i < MAX_SNAPSHOT_SUFFIX; i++) {
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GFileOutputStream) stream = NULL;
+    g_autoptr (GError) err = NULL;
+    g_autofree char *name = NULL;
+    g_autofree char *path = NULL;
+
+    if (i == 0)
+      name = g_strdup_printf ("%s.%s", data->name, data->ext);
+    else
+      name = g_strdup_printf ("%s (%u).%s", data->name, i, data->ext);
+    path = g_build_filename (data->dir, name, NULL);
+    file = g_file_new_for_path (path);
+
+    stream = g_file_create (file, G_FILE_CREATE_NONE, cancellable, &err);
+    if (stream == NULL) {
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        continue;
+
+      g_propagate_error (error, g_steal_pointer (&err));
+      return FALSE;
+    }
+
+    if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                    g_bytes_get_data (bytes, NULL),
+                                    g_bytes_get_size (bytes),
+                                    NULL,
+                                    cancellable,
+                                    error) ||
+        !g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, error)) {
+      g_file_delete (file, NULL, NULL);
+      return FALSE;
+    }
+
+    data->path = g_steal_pointer (&path);
+    return TRUE;
+  }
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS, "No free file name for %s", data->name);
+  return FALSE;
+}
+
+
+#ifdef HAVE_GSTREAMER_DRM
+/*
+ * videoconvert can't handle DMA_DRM caps. Linear dmabufs can still be
+ * mapped though so describe the buffer with its plain format and
+ * convert that instead.
+ */
+static GstSample *
+snapshot_from_dma_drm (LiviSnapshotData *data)
+{
+  g_autoptr (GstElement) pipeline = gst_play_get_pipeline (data->player);
+  g_autoptr (GstSample) sample = NULL;
+  g_autoptr (GstSample) plain = NULL;
+  g_autoptr (GstCaps) caps = NULL;
+  g_autoptr (GstCaps) to_caps = NULL;
+  g_autoptr (GError) err = NULL;
+  GstVideoInfoDmaDrm drm_info;
+  GstVideoInfo info;
+  GstSample *snapshot;
+
+  g_object_get (pipeline, "sample", &sample, NULL);
+  if (sample == NULL || gst_sample_get_buffer (sample) == NULL)
+    return NULL;
+
+  if (!gst_video_is_dma_drm_caps (gst_sample_get_caps (sample)) ||
+      !gst_video_info_dma_drm_from_caps (&drm_info, gst_sample_get_caps (sample)))
+    return NULL;
+
+  /* Tiled or compressed layouts can't be read back by the CPU */
+  if (drm_info.drm_modifier != DRM_FORMAT_MOD_LINEAR ||
+      !gst_video_info_dma_drm_to_video_info (&drm_info, &info))
+    return NULL;
+
+  caps = gst_video_info_to_caps (&info);
+  plain = gst_sample_new (gst_sample_get_buffer (sample), caps, NULL, NULL);
+
+  if (data->format == GST_PLAY_THUMBNAIL_JPG)
+    to_caps = gst_caps_new_empty_simple ("image/jpeg");
+  else
+    to_caps = gst_caps_new_empty_simple ("image/png");
+
+  snapshot = gst_video_convert_sample (plain, to_caps, 25 * GST_SECOND, &err);
+  if (snapshot == NULL)
+    g_debug ("Failed to convert dmabuf frame: %s", err ? err->message : "unknown error");
+
+  return snapshot;
+}
+#endif
+
+/*
+ * Runs in a worker thread: GStreamer reads back the last frame (which
+ * for GL memory happens on its own GL thread) and encodes it so the
+ * main loop and thus playback doesn't stall.
+ */
+static void
+snapshot_thread (GTask        *task,
+                 gpointer      source_object,
+                 gpointer      task_data,
+                 GCancellable *cancellable)
+{
+  LiviSnapshotData *data = task_data;
+  g_autoptr (GstSample) sample = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GError) err = NULL;
+  GstBuffer *buffer;
+  GstMapInfo map;
+
+  /* Fails for formats videoconvert can't handle like DMA_DRM */
+  sample = gst_play_get_video_snapshot (data->player, data->format, NULL);
+#ifdef HAVE_GSTREAMER_DRM
+  if (sample == NULL)
+    sample = snapshot_from_dma_drm (data);
+#endif
+
+  buffer = sample ? gst_sample_get_buffer (sample) : NULL;
+  if (buffer && gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    bytes = g_bytes_new (map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+  }
+
+  if (bytes == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Can't convert the video frame");
+    return;
+  }
+
+  if (!snapshot_write (data, bytes, cancellable, &err)) {
+    g_task_return_error (task, g_steal_pointer (&err));
+    return;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+static void
+on_snapshot_saved (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (source_object);
+  LiviSnapshotData *data = g_task_get_task_data (G_TASK (res));
+  g_autoptr (GError) err = NULL;
+
+  if (!g_task_propagate_boolean (G_TASK (res), &err)) {
+    g_autofree char *msg = NULL;
+
+    g_warning ("Failed to save snapshot: %s", err->message);
+    /* Translators: The placeholder is the error message */
+    msg = g_strdup_printf (_("Snapshot failed: %s"), err->message);
+    show_center_overlay (self, "dialog-warning-symbolic", msg, TRUE);
+    return;
+  }
+
+  g_debug ("Saved snapshot to %s", data->path);
+  show_center_overlay (self, "camera-photo-symbolic", _("Snapshot saved"), TRUE);
+}
+
+
+/*
+ * Saves the current frame to the pictures folder. All readback and
+ * encoding happens in a worker thread.
+ */
+static void
+take_snapshot (LiviWindow *self)
+{
+  g_autoptr (GTask) task = NULL;
+  g_autofree char *format = NULL;
+  LiviSnapshotData *data;
+  const char *dir;
+  guint64 pos_s;
+
+  format = g_settings_get_string (self->settings, "snapshot-format");
+
+  data = g_new0 (LiviSnapshotData, 1);
+  data->player = gst_object_ref (self->player);
+  if (g_strcmp0 (format, "jpeg") == 0) {
+    data->format = GST_PLAY_THUMBNAIL_JPG;
+    data->ext = "jpg";
+  } else {
+    data->format = GST_PLAY_THUMBNAIL_PNG;
+    data->ext = "png";
+  }
+
+  dir = g_get_user_special_dir (G_USER_DIRECTORY_PICTURES);
+  if (dir == NULL)
+    dir = g_get_home_dir ();
+  data->dir = g_strdup (dir);
+
+  pos_s = self->stream.position_ns / GST_SECOND;
+  data->name = g_strdup_printf ("%s %02" G_GUINT64_FORMAT "-%02" G_GUINT64_FORMAT "-%02" G_GUINT64_FORMAT,
+                                self->stream.title ? self->stream.title : "Livi",
+                                pos_s / 3600, (pos_s / 60) % 60, pos_s % 60);
+  g_strdelimit (data->name, G_DIR_SEPARATOR_S, '-');
+
+  task = g_task_new (self, NULL, on_snapshot_saved, NULL);
+  g_task_set_source_tag (task, take_snapshot);
+  g_task_set_task_data (task, data, (GDestroyNotify) snapshot_data_free);
+  g_task_run_in_thread (task, snapshot_thread);
+}
+
+
+static void
+on_snapshot_activated (GtkWidget *widget, const char *action_name, GVariant *unused)
+{
+  LiviWindow *self = LIVI_WINDOW (widget);
+
+  if (!self->player || !self->num_video_streams)
+    return;
+
+  take_snapshot (self);
+}
+
+
+static void
+hide_subtitle (gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (user_data);
+
+  self->subtitle_hide_id = 0;
+  self->subtitle_remaining = 0;
+  gtk_widget_set_visible (GTK_WIDGET (self->lbl_subtitle), FALSE);
+}
+
+
+static void
+pause_subtitle (LiviWindow *self)
+{
+  if (self->subtitle_hide_id == 0)
+    return;
+
+  g_clear_handle_id (&self->subtitle_hide_id, g_source_remove);
+  self->subtitle_remaining = MAX (self->subtitle_hide_time - g_get_monotonic_time (), 0);
+}
+
+
+static void
+resume_subtitle (LiviWindow *self)
+{
+  if (self->subtitle_hide_id || self->subtitle_remaining <= 0)
+    return;
+
+  self->subtitle_hide_time = g_get_monotonic_time () + self->subtitle_remaining;
+  self->subtitle_hide_id = g_timeout_add_once (self->subtitle_remaining / 1000, hide_subtitle, self);
+}
+
+
+static void
+show_subtitle (LiviWindow *self, const char *markup, GstClockTime duration)
+{
+  g_clear_handle_id (&self->subtitle_hide_id, g_source_remove);
+  self->subtitle_remaining = 0;
+
+  if (markup == NULL || markup[0] == '\0') {
+    gtk_widget_set_visible (GTK_WIDGET (self->lbl_subtitle), FALSE);
+    return;
+  }
+
+  /* The label keeps its layout as long as the cue stays the same */
+  if (g_strcmp0 (markup, gtk_label_get_label (self->lbl_subtitle)))
+    gtk_label_set_markup (self->lbl_subtitle, markup);
+  gtk_widget_set_visible (GTK_WIDGET (self->lbl_subtitle), TRUE);
+
+  if (GST_CLOCK_TIME_IS_VALID (duration)) {
+    self->subtitle_remaining = (duration / GST_USECOND) * 100 / self->stream.playback_speed;
+    /* Cues shown while paused (e.g. after a seek) stay until playback continues */
+    if (self->state == GST_PLAY_STATE_PLAYING)
+      resume_subtitle (self);
+  }
+}
+
+
+typedef struct _LiviSubtitleCue {
+  LiviWindow   *window;
+  char         *markup;
+  GstClockTime  duration;
+} LiviSubtitleCue;
+
+
+static void
+subtitle_cue_free (LiviSubtitleCue *cue)
+{
+  g_object_unref (cue->window);
+  g_free (cue->markup);
+  g_free (cue);
+}
+
+
+static gboolean
+on_subtitle_cue (gpointer user_data)
+{
+  LiviSubtitleCue *cue = user_data;
+
+  /* Window got closed in the meantime */
+  if (cue->window->lbl_subtitle == NULL)
+    return G_SOURCE_REMOVE;
+
+  show_subtitle (cue->window, cue->markup, cue->duration);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Called on the streaming thread */
+static void
+queue_subtitle (LiviWindow *self, GstSample *sample)
+{
+  GstBuffer *buffer = gst_sample_get_buffer (sample);
+  GstCaps *caps = gst_sample_get_caps (sample);
+  const char *format;
+  LiviSubtitleCue *cue;
+  GstStructure *s;
+  GstMapInfo map;
+
+  if (buffer == NULL || caps == NULL)
+    return;
+
+  /* Bitmap subtitles aren't supported */
+  s = gst_caps_get_structure (caps, 0);
+  if (!gst_structure_has_name (s, "text/x-raw"))
+    return;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return;
+
+  cue = g_new0 (LiviSubtitleCue, 1);
+  cue->window = g_object_ref (self);
+  cue->duration = GST_BUFFER_DURATION (buffer);
+  format = gst_structure_get_string (s, "format");
+  if (g_strcmp0 (format, "pango-markup") == 0)
+    cue->markup = g_strndup ((char *)map.data, map.size);
+  else
+    cue->markup = g_markup_escape_text ((char *)map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+
+  g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT, on_subtitle_cue, cue,
+                              (GDestroyNotify) subtitle_cue_free);
+}
+
+
+static GstFlowReturn
+on_subtitle_sample (GstAppSink *appsink, gpointer user_data)
+{
+  g_autoptr (GstSample) sample = gst_app_sink_pull_sample (appsink);
+
+  if (sample)
+    queue_subtitle (LIVI_WINDOW (user_data), sample);
+
+  return GST_FLOW_OK;
+}
+
+
+static GstFlowReturn
+on_subtitle_preroll (GstAppSink *appsink, gpointer user_data)
+{
+  g_autoptr (GstSample) sample = gst_app_sink_pull_preroll (appsink);
+
+  if (sample)
+    queue_subtitle (LIVI_WINDOW (user_data), sample);
+
+  return GST_FLOW_OK;
+}
+
+
+/*
+ * Route text subtitles to us instead of having them rendered into the
+ * video frames so they can be drawn on top.
+ */
+static void
+setup_subtitle_sink (LiviWindow *self)
+{
+  GstAppSinkCallbacks callbacks = {
+    .new_preroll = on_subtitle_preroll,
+    .new_sample = on_subtitle_sample,
+  };
+  g_autoptr (GstElement) pipeline = NULL;
+  GstElement *appsink;
+
+  appsink = gst_element_factory_make ("appsink", "livi-subtitle-sink");
+  if (appsink == NULL) {
+    g_warning ("appsink not available, can't draw subtitles");
+    return;
+  }
+
+  /* Subtitles are sparse, don't wait for them */
+  g_object_set (appsink, "async", FALSE, NULL);
+  gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, self, NULL);
+
+  pipeline = gst_play_get_pipeline (self->player);
+  g_object_set (pipeline, "text-sink", appsink, NULL);
+
+  g_debug ("Drawing text subtitles natively");
+}
+
+
+typedef struct _LiviSpectrumBands {
+  LiviWindow   *window;
+  GArray       *magnitudes;
+} LiviSpectrumBands;
+
+
+static void
+spectrum_bands_free (LiviSpectrumBands *bands)
+{
+  g_object_unref (bands->window);
+  g_array_unref (bands->magnitudes);
+  g_free (bands);
+}
+
+
+static gboolean
+on_spectrum_bands (gpointer user_data)
+{
+  LiviSpectrumBands *bands = user_data;
+
+  /* Window got closed in the meantime */
+  if (bands->window->spectrum == NULL)
+    return G_SOURCE_REMOVE;
+
+  livi_spectrum_set_magnitudes (bands->window->spectrum,
+                                (float *)bands->magnitudes->data,
+                                bands->magnitudes->len);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Called on the player's thread */
+static void
+on_spectrum_message (GstBus *bus, GstMessage *message, gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (user_data);
+  const GstStructure *s = gst_message_get_structure (message);
+  LiviSpectrumBands *bands;
+  const GValue *list;
+  guint n_bands;
+
+  if (GST_MESSAGE_SRC (message) != GST_OBJECT (self->spectrum_filter))
+    return;
+
+  if (!gst_structure_has_name (s, "spectrum"))
+    return;
+
+  list = gst_structure_get_value (s, "magnitude");
+  if (list == NULL || !GST_VALUE_HOLDS_LIST (list))
+    return;
+
+  n_bands = gst_value_list_get_size (list);
+  bands = g_new0 (LiviSpectrumBands, 1);
+  bands->window = g_object_ref (self);
+  bands->magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (float), n_bands);
+  for (guint i = 0; i < n_bands; i++) {
+    float magnitude = g_value_get_float (gst_value_list_get_value (list, i));
+
+    g_array_append_val (bands->magnitudes, magnitude);
+  }
+
+  g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT, on_spectrum_bands, bands,
+                              (GDestroyNotify) spectrum_bands_free);
+}
+
+
+/*
+ * Instead of rendering video frames for audio only streams let the
+ * spectrum element post a few band magnitudes which we then draw
+ * ourselves.
+ */
+static void
+setup_spectrum_filter (LiviWindow *self)
+{
+  g_autoptr (GstElement) pipeline = NULL;
+  g_autoptr (GstBus) bus = NULL;
+
+  self->spectrum_filter = gst_element_factory_make ("spectrum", "livi-spectrum");
+  if (self->spectrum_filter == NULL) {
+    g_warning ("spectrum not available, can't use builtin visualization");
+    return;
+  }
+  gst_object_ref_sink (self->spectrum_filter);
+
+  g_object_set (self->spectrum_filter,
+                "bands", 32,
+                "threshold", -60,
+                "interval", 50 * GST_MSECOND,
+                /* Only enabled for audio only streams, see set_spectrum_enabled () */
+                "post-messages", FALSE,
+                "message-phase", FALSE,
+                NULL);
+
+  pipeline = gst_play_get_pipeline (self->player);
+  g_object_set (pipeline, "audio-filter", self->spectrum_filter, NULL);
+
+  bus = gst_element_get_bus (pipeline);
+  g_signal_connect_object (bus, "message::element", G_CALLBACK (on_spectrum_message), self, 0);
+}
+
+
+static void
+on_subtitle_stream_action_changed_state (GSimpleAction *action, GVariant *param, gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (user_data);
+  gboolean enable = FALSE;
+  gint index;
+
+  index = g_variant_get_int32 (param);
+
+  if (index >= 0) {
+    gst_play_set_subtitle_track (self->player, index);
+    g_debug ("Enabling subtitle track %d", index);
+    enable = TRUE;
+  }
+
+  gst_play_set_subtitle_track_enabled (self->player, enable);
+  if (!enable)
+    show_subtitle (self, NULL, GST_CLOCK_TIME_NONE);
+
+  g_simple_action_set_state(action, param);
+}
+
+
+static void
+on_audio_stream_action_changed_state (GSimpleAction *action, GVariant *param, gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (user_data);
+  gint index;
+
+  index = g_variant_get_int32 (param);
+
+  gst_play_set_audio_track (self->player, index);
+
+  g_simple_action_set_state(action, param);
+}
+
+
+static void
+on_file_chooser_done (GObject *object, GAsyncResult *response, gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (user_data);
+  g_autoptr (GtkFileDialog) dialog = GTK_FILE_DIALOG (object);
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *uri = NULL;
+
+  file = gtk_file_dialog_open_finish (dialog, response, &err);
+  if (!file) {
+    if (!g_error_matches (err, GTK_DIALOG_ERROR, GTK_DIALOG_ERROR_DISMISSED))
+        g_warning ("Failed to select file: %s", err->message);
+    return;
+  }
+
+  uri = g_file_get_uri (file);
+  livi_window_play_uri (self, uri, NULL);
+  g_free (self->last_local_uri);
+  self->last_local_uri = g_steal_pointer (&uri);
+}
+
+
+static void
+on_open_file_activated (GtkWidget *widget, const char *action_name, GVariant *unused)
+{
+  LiviWindow *self = LIVI_WINDOW (widget);
+  GtkFileDialog *dialog;
+
+  /* Otherwise the portal dialog can set this as proper parent */
+  gtk_window_unfullscreen (GTK_WINDOW (self));
+
+  dialog = gtk_file_dialog_new ();
+  gtk_file_dialog_set_title (dialog, _("Choose a video to play"));
+  gtk_file_dialog_set_default_filter (dialog, self->video_filter);
+
+  if (!STR_IS_NULL_OR_EMPTY (self->last_local_uri)) {
+    g_autoptr (GFile) current_file = g_file_new_for_uri (self->last_local_uri);
+    gtk_file_dialog_set_initial_file (dialog, current_file);
+  } else {
+    const char *dir;
+
+    dir = g_get_user_special_dir (G_USER_DIRECTORY_VIDEOS);
+    if (dir) {
+      g_autoptr (GFile) videos_dir = g_file_new_for_path (dir);
+      gtk_file_dialog_set_initial_folder (dialog, videos_dir);
+    }
+  }
+
+  gtk_file_dialog_open (dialog, GTK_WINDOW (self), NULL, on_file_chooser_done, self);
+}
+
+
+/* Wait that long after the last seek request before seeking accurately */
+#define SEEK_SETTLE_MS      250
+/* Don't wait longer than that for a seek to complete */
+#define SEEK_TIMEOUT_US     (1 * G_USEC_PER_SEC)
+
+static void
+reset_seek (LiviWindow *self)
+{
+  g_clear_handle_id (&self->seek.settle_id, g_source_remove);
+  self->seek.active = FALSE;
+  self->seek.in_flight = FALSE;
+  self->seek.pending = FALSE;
+}
+
+
+static void
+dispatch_seek (LiviWindow *self)
+{
+  g_autoptr (GstElement) pipeline = NULL;
+  GstSeekFlags flags = GST_SEEK_FLAG_FLUSH;
+  gboolean success;
+
+  self->seek.pending = FALSE;
+
+  if (self->seek.accurate)
+    flags |= GST_SEEK_FLAG_ACCURATE;
+  else
+    flags |= GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST;
+
+  pipeline = gst_play_get_pipeline (self->player);
+  success = gst_element_seek (pipeline, self->stream.playback_speed / 100.0,
+                              GST_FORMAT_TIME, flags,
+                              GST_SEEK_TYPE_SET, self->seek.target,
+                              GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+  g_debug ("%s seek to %" GST_TIME_FORMAT,
+           self->seek.accurate ? "Accurate" : "Key unit",
+           GST_TIME_ARGS (self->seek.target));
+
+  if (!success) {
+    /* E.g. not prerolled yet, let the player handle it */
+    g_debug ("Seek failed, deferring to player");
+    player_seek (self, self->seek.target);
+    self->seek.in_flight = FALSE;
+    if (self->seek.accurate)
+      self->seek.active = FALSE;
+    return;
+  }
+
+  self->seek.in_flight = TRUE;
+  self->seek.started = g_get_monotonic_time ();
+}
+
+
+static void
+on_seek_settled (gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (user_data);
+
+  self->seek.settle_id = 0;
+
+  /* Land exactly where requested now that scrubbing stopped */
+  self->seek.accurate = TRUE;
+  self->seek.pending = TRUE;
+  if (!self->seek.in_flight)
+    dispatch_seek (self);
+}
+
+
+/*
+ * Keep at most one seek in flight: seeks requested while another one
+ * is in progress only update the target. While scrubbing use fast key
+ * unit seeks and do a single accurate one once things settle.
+ */
+static void
+queue_seek (LiviWindow *self, GstClockTime pos)
+{
+  /* Seeking at the regular rate ends trick mode */
+  self->stream.trick_rate = 0;
+
+  self->seek.active = TRUE;
+  self->seek.target = pos;
+  self->seek.pending = TRUE;
+  self->seek.accurate = FALSE;
+
+  g_clear_handle_id (&self->seek.settle_id, g_source_remove);
+  self->seek.settle_id = g_timeout_add_once (SEEK_SETTLE_MS, on_seek_settled, self);
+
+  if (self->seek.in_flight &&
+      g_get_monotonic_time () - self->seek.started < SEEK_TIMEOUT_US) {
+    return;
+  }
+
+  dispatch_seek (self);
+}
+
+
+static gboolean
+on_seek_done (gpointer user_data)
+{
+  LiviWindow *self = LIVI_WINDOW (user_data);
+
+  if (self->player == NULL || !self->seek.in_flight)
+    return G_SOURCE_REMOVE;
+
+  self->seek.in_flight = FALSE;
+
+  if (self->seek.pending) {
+    dispatch_seek (self);
+  } else if (self->seek.accurate) {
+    self->seek.active = FALSE;
+    livi_controls_set_position (self->controls, self->seek.target);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Called on the player's thread */
+static void
+on_async_done (GstBus *bus, GstMessage *message, gpointer user_data)
+{
+  g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT, on_seek_done,
+                              g_object_ref (user_data), g_object_unref);
+}
+
+
+/* Current position taking seeks that didn't complete yet into account */
+static GstClockTime
+get_seek_base (LiviWindow *self)
+{
+  if (self->seek.active)
+    return self->seek.target;
+
+  return gst_play_get_position (self->player);
+}
+
+
+static void
+move_stream_to_pos (LiviWindow *self, GstClockTime pos, const char *label)
+{
+  GstClockTime current;
+  const char *icon_name;
+
+  current = get_seek_base (self);
+
+  if (pos == current)
+    return;
+
+  icon_name = (pos > current) ? "media-seek-forward-symbolic" : "media-seek-backward-symbolic";
+  show_center_overlay (self, icon_name, label, TRUE);
+  queue_seek (self, pos);
+}
+
+
+#define MIN_TRICK_RATE 4
+#define MAX_TRICK_RATE 64
+
+/*
+ * Fast forward and rewind by only decoding key frames. A rate of 0
+ * switches back to normal playback at the current position.
+ */
+static gboolean
+set_trick_rate (LiviWindow *self, int rate)
+{
+  g_autoptr (GstElement) pipeline = NULL;
+  GstSeekFlags flags = GST_SEEK_FLAG_FLUSH;
+  GstClockTime pos;
+  gboolean success;
+
+  reset_seek (self);
+  pos = gst_play_get_position (self->player);
+  pipeline = gst_play_get_pipeline (self->player);
+
+  if (rate == 0) {
+    flags |= GST_SEEK_FLAG_ACCURATE;
+    success = gst_element_seek (pipeline, self->stream.playback_speed / 100.0,
+                                GST_FORMAT_TIME, flags,
+                                GST_SEEK_TYPE_SET, pos,
+                                GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+  } else {
+    flags |= GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS |
+      GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
+    /* Playing backwards runs from the segment's stop to its start */
+    success = gst_element_seek (pipeline, rate,
+                                GST_FORMAT_TIME, flags,
+                                GST_SEEK_TYPE_SET, rate > 0 ? pos : 0,
+                                rate > 0 ? GST_SEEK_TYPE_NONE : GST_SEEK_TYPE_SET,
+                                rate > 0 ? GST_CLOCK_TIME_NONE : pos);
+  }
+
+  if (!success) {
+    g_warning ("Failed to switch to playback rate %d", rate);
+    return FALSE;
+  }
+
+  g_debug ("Trick mode rate %d at %" GST_TIME_FORMAT, rate, GST_TIME_ARGS (pos));
+  self->stream.trick_rate = rate;
+  return TRUE;
+}
+
+
+static void
+on_trick_mode_activated (GtkWidget *widget, const char *action_name, GVariant *param)
+{
+  LiviWindow *self = LIVI_WINDOW (widget);
+  g_autofree char *label = NULL;
+  int rate = self->stream.trick_rate;
+  const char *icon_name;
+
+  /* Each activation doubles the rate in the given direction */
+  if (g_variant_get_int32 (param) > 0)
+    rate = rate > 0 ? MIN (rate * 2, MAX_TRICK_RATE) : MIN_TRICK_RATE;
+  else
+    rate = rate < 0 ? MAX (rate * 2, -MAX_TRICK_RATE) : -MIN_TRICK_RATE;
+
+  if (rate == self->stream.trick_rate)
+    return;
+
+  if (!set_trick_rate (self, rate))
+    return;
+
+  if (self->state != GST_PLAY_STATE_PLAYING)
+    gst_play_play (self->player);
+
+  icon_name = rate > 0 ? "media-seek-forward-symbolic" : "media-seek-backward-symbolic";
+  label = g_strdup_printf (_("× %d"), ABS (rate));
+  g_clear_handle_id (&self->reveal_id, g_source_remove);
+  show_center_overlay (self, icon_name, label, FALSE);
+}
+
+
+static void
+on_ff_rev_activated (GtkWidget *widget, const char *action_name, GVariant *param)
+{
+  LiviWindow *self = LIVI_WINDOW (widget);
+  GstClockTime pos;
+  g_autofree char *label = NULL;
+  gint64 offset;
+
+  offset = g_variant_get_int32 (param) * GST_MSECOND;
+  pos = get_seek_base (self);
+
+  if (offset < 0 && labs(offset) > pos)
+    pos = 0;
+  else
+    pos += offset;
 
-  gtk_revealer_set_reveal_child (self->revealer_center, FALSE);
+  label = g_strdup_printf (_("%.2lds"), labs(offset / GST_SECOND));
+  move_stream_to_pos (self, pos, label);
 }
 
 
 static void
-show_resume_or_restart_overlay (LiviWindow *self, gboolean can_resume)
+on_seek_activated (GtkWidget *widget, const char *action_name, GVariant *param)
 {
-  gtk_widget_set_visible (GTK_WIDGET (self->btn_resume), can_resume);
-  gtk_stack_set_visible_child (self->stack_center, GTK_WIDGET (self->box_resume_or_restart));
-  gtk_revealer_set_reveal_child (self->revealer_center, TRUE);
+  LiviWindow *self = LIVI_WINDOW (widget);
+  gint64 pos;
 
-  self->seek_target_state = STREAM_TARGET_STATE_PREVIEW;
+  pos = g_variant_get_int32 (param) * GST_MSECOND;
+  move_stream_to_pos (self, pos, NULL);
 }
 
 
-static void
-toggle_controls (LiviWindow *self)
-{
-  gboolean revealed;
+/*
+ * Cached frames hold on to the decoder's buffers so only keep a few,
+ * stepping back further than that decodes the GOP again. The sink
+ * asks the decoder for that many more buffers while stepping.
+ */
+#define FRAME_CACHE_FRAMES  8
+#define FRAME_CACHE_BYTES   (256 * 1024 * 1024)
+/* Don't wait longer than that for the frame a step leads to */
+#define STEP_TIMEOUT_US     (1 * G_USEC_PER_SEC)
 
-  g_assert (LIVI_IS_WINDOW (self));
+static GstClockTime
+query_position (LiviWindow *self)
+{
+  g_autoptr (GstElement) pipeline = gst_play_get_pipeline (self->player);
+  gint64 pos;
 
-  revealed = adw_toolbar_view_get_reveal_bottom_bars (self->toolbar);
+  if (!gst_element_query_position (pipeline, GST_FORMAT_TIME, &pos))
+    return GST_CLOCK_TIME_NONE;
 
-  if (!revealed)
-    show_controls (self);
-  else
-    hide_controls (self);
+  return pos;
 }
 
 
-static void
-on_toggle_controls_activated (GtkWidget  *widget, const char *action_name, GVariant *unused)
+static gboolean
+send_step (LiviWindow *self)
 {
-  toggle_controls (LIVI_WINDOW (widget));
+  g_autoptr (GstElement) pipeline = gst_play_get_pipeline (self->player);
+
+  if (!gst_element_send_event (pipeline, gst_event_new_step (GST_FORMAT_BUFFERS, 1, 1.0, TRUE, FALSE))) {
+    g_warning ("Failed to step");
+    return FALSE;
+  }
+
+  self->step.stepped = TRUE;
+  return TRUE;
 }
 
 
-static void
-on_toggle_play_activated (GtkWidget  *widget, const char *action_name, GVariant *unused)
+static gboolean
+seek_for_step (LiviWindow *self, GstClockTime pos, GstSeekFlags flags)
 {
-  LiviWindow *self = LIVI_WINDOW (widget);
-  const char *icon_name;
-  gboolean fade;
-
-  if (self->state == GST_PLAY_STATE_PLAYING) {
-    gst_play_pause (self->player);
-    icon_name = "media-playback-pause-symbolic";
-    fade = FALSE;
-  } else {
-    gst_play_play (self->player);
-    icon_name = "media-playback-start-symbolic";
-    fade = TRUE;
+  g_autoptr (GstElement) pipeline = gst_play_get_pipeline (self->player);
+
+  reset_seek (self);
+  if (!gst_element_seek (pipeline, self->stream.playback_speed / 100.0,
+                         GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | flags,
+                         GST_SEEK_TYPE_SET, pos,
+                         GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE)) {
+    g_warning ("Failed to seek to %" GST_TIME_FORMAT, GST_TIME_ARGS (pos));
+    return FALSE;
   }
 
-  show_center_overlay (self, icon_name, NULL, fade);
-  gtk_stack_set_visible_child (self->stack_content, GTK_WIDGET (self->box_content));
+  self->step.stepped = FALSE;
+  return TRUE;
 }
 
 
 static void
-on_restart_activated (GtkWidget  *widget, const char *action_name, GVariant *unused)
+show_step_frame (LiviWindow *self, GdkTexture *texture, LiviGstFrame *frame, GstClockTime pts)
 {
-  LiviWindow *self = LIVI_WINDOW (widget);
-
-  self->seek_target_state = STREAM_TARGET_STATE_PLAY;
-  gst_play_seek (self->player, 0);
+  livi_gst_paintable_show_texture (LIVI_GST_PAINTABLE (self->paintable), texture, frame);
+  self->step.pts = pts;
+  livi_controls_set_position (self->controls, pts);
 }
 
 
+/*
+ * Called whenever a decoded frame got shown. While stepping keep
+ * frames in the cache so stepping back doesn't need to decode them
+ * again.
+ */
 static void
-on_subtitle_stream_action_changed_state (GSimpleAction *action, GVariant *param, gpointer user_data)
+on_frame_presented (LiviWindow *self)
 {
-  LiviWindow *self = LIVI_WINDOW (user_data);
-  gboolean enable = FALSE;
-  gint index;
+  LiviGstPaintable *paintable = LIVI_GST_PAINTABLE (self->paintable);
+  GstClockTime pos, prev_pts;
+  LiviGstFrame *frame;
+  GdkTexture *texture;
 
-  index = g_variant_get_int32 (param);
+  if (!self->step.active)
+    return;
 
-  if (index >= 0) {
-    gst_play_set_subtitle_track (self->player, index);
-    g_debug ("Enabling subtitle track %d", index);
-    enable = TRUE;
+  texture = livi_gst_paintable_get_texture (paintable);
+  pos = query_position (self);
+  if (texture == NULL || !GST_CLOCK_TIME_IS_VALID (pos)) {
+    self->step.busy = FALSE;
+    return;
   }
 
-  gst_play_set_subtitle_track_enabled (self->player, enable);
+  /* Only frames we stepped to are known to follow the previous one */
+  prev_pts = self->step.stepped ? self->step.decoded_pts : GST_CLOCK_TIME_NONE;
+  livi_frame_cache_add (self->step.cache, texture, livi_gst_paintable_get_frame (paintable),
+                        pos, prev_pts);
+  self->step.stepped = FALSE;
+  self->step.pts = self->step.decoded_pts = pos;
+  livi_controls_set_position (self->controls, pos);
+
+  if (GST_CLOCK_TIME_IS_VALID (self->step.fill_target)) {
+    GstClockTime target = self->step.fill_target;
+
+    /* Decode up to the frame we started from */
+    if (pos < target && send_step (self))
+      return;
+
+    self->step.fill_target = GST_CLOCK_TIME_NONE;
+    texture = livi_frame_cache_get_previous (self->step.cache, target, &prev_pts, &frame);
+    if (texture)
+      show_step_frame (self, texture, frame, prev_pts);
+  } else if (self->step.step_after_seek) {
+    self->step.step_after_seek = FALSE;
+    if (send_step (self))
+      return;
+  }
 
-  g_simple_action_set_state(action, param);
+  self->step.busy = FALSE;
 }
 
 
 static void
-on_audio_stream_action_changed_state (GSimpleAction *action, GVariant *param, gpointer user_data)
+start_stepping (LiviWindow *self)
 {
-  LiviWindow *self = LIVI_WINDOW (user_data);
-  gint index;
+  LiviGstPaintable *paintable = LIVI_GST_PAINTABLE (self->paintable);
+  GdkTexture *texture;
+  GstClockTime pos;
 
-  index = g_variant_get_int32 (param);
+  if (self->step.active)
+    return;
 
-  gst_play_set_audio_track (self->player, index);
+  if (self->stream.trick_rate)
+    set_trick_rate (self, 0);
 
-  g_simple_action_set_state(action, param);
-}
+  if (self->state == GST_PLAY_STATE_PLAYING)
+    gst_play_pause (self->player);
 
+  self->step.active = TRUE;
+  self->step.stepped = FALSE;
+  self->step.fill_target = GST_CLOCK_TIME_NONE;
+  livi_gst_paintable_set_held_frames (paintable, FRAME_CACHE_FRAMES);
 
-static void
-on_file_chooser_done (GObject *object, GAsyncResult *response, gpointer user_data)
-{
-  LiviWindow *self = LIVI_WINDOW (user_data);
-  g_autoptr (GtkFileDialog) dialog = GTK_FILE_DIALOG (object);
-  g_autoptr (GFile) file = NULL;
-  g_autoptr (GError) err = NULL;
-  g_autofree char *uri = NULL;
+  pos = query_position (self);
+  self->step.pts = self->step.decoded_pts = pos;
 
-  file = gtk_file_dialog_open_finish (dialog, response, &err);
-  if (!file) {
-    if (!g_error_matches (err, GTK_DIALOG_ERROR, GTK_DIALOG_ERROR_DISMISSED))
-        g_warning ("Failed to select file: %s", err->message);
-    return;
+  texture = livi_gst_paintable_get_texture (paintable);
+  if (texture && GST_CLOCK_TIME_IS_VALID (pos)) {
+    livi_frame_cache_add (self->step.cache, texture, livi_gst_paintable_get_frame (paintable),
+                          pos, GST_CLOCK_TIME_NONE);
   }
-
-  uri = g_file_get_uri (file);
-  livi_window_play_uri (self, uri, NULL);
-  g_free (self->last_local_uri);
-  self->last_local_uri = g_steal_pointer (&uri);
 }
 
 
 static void
-on_open_file_activated (GtkWidget *widget, const char *action_name, GVariant *unused)
+stop_stepping (LiviWindow *self)
 {
-  LiviWindow *self = LIVI_WINDOW (widget);
-  GtkFileDialog *dialog;
-
-  /* Otherwise the portal dialog can set this as proper parent */
-  gtk_window_unfullscreen (GTK_WINDOW (self));
-
-  dialog = gtk_file_dialog_new ();
-  gtk_file_dialog_set_title (dialog, _("Choose a video to play"));
-  gtk_file_dialog_set_default_filter (dialog, self->video_filter);
-
-  if (!STR_IS_NULL_OR_EMPTY (self->last_local_uri)) {
-    g_autoptr (GFile) current_file = g_file_new_for_uri (self->last_local_uri);
-    gtk_file_dialog_set_initial_file (dialog, current_file);
-  } else {
-    const char *dir;
+  if (!self->step.active)
+    return;
 
-    dir = g_get_user_special_dir (G_USER_DIRECTORY_VIDEOS);
-    if (dir) {
-      g_autoptr (GFile) videos_dir = g_file_new_for_path (dir);
-      gtk_file_dialog_set_initial_folder (dialog, videos_dir);
-    }
-  }
+  /* Continue from the frame that is shown */
+  if (self->step.pts != self->step.decoded_pts && GST_CLOCK_TIME_IS_VALID (self->step.pts))
+    player_seek (self, self->step.pts);
 
-  gtk_file_dialog_open (dialog, GTK_WINDOW (self), NULL, on_file_chooser_done, self);
+  self->step.active = FALSE;
+  self->step.busy = FALSE;
+  self->step.step_after_seek = FALSE;
+  livi_frame_cache_clear (self->step.cache);
+  livi_gst_paintable_set_held_frames (LIVI_GST_PAINTABLE (self->paintable), 0);
 }
 
 
 static void
-move_stream_to_pos (LiviWindow *self, GstClockTime pos, const char *label)
+step_forward (LiviWindow *self)
 {
-  GstClockTime current;
-  const char *icon_name;
-
-  current = gst_play_get_position (self->player);
+  LiviGstFrame *frame;
+  GdkTexture *texture;
+  GstClockTime next_pts;
 
-  if (pos == current)
+  texture = livi_frame_cache_get_next (self->step.cache, self->step.pts, &next_pts, &frame);
+  if (texture) {
+    show_step_frame (self, texture, frame, next_pts);
     return;
+  }
 
-  icon_name = (pos > current) ? "media-seek-forward-symbolic" : "media-seek-backward-symbolic";
-  show_center_overlay (self, icon_name, label, TRUE);
-  gst_play_seek (self->player, pos);
+  if (self->step.pts == self->step.decoded_pts) {
+    self->step.busy = send_step (self);
+  } else {
+    /* Not decoded yet, go back to the shown frame first */
+    self->step.busy = seek_for_step (self, self->step.pts, GST_SEEK_FLAG_ACCURATE);
+    self->step.step_after_seek = self->step.busy;
+  }
 }
 
 
 static void
-on_ff_rev_activated (GtkWidget *widget, const char *action_name, GVariant *param)
+step_backward (LiviWindow *self)
 {
-  LiviWindow *self = LIVI_WINDOW (widget);
-  GstClockTime pos;
-  g_autofree char *label = NULL;
-  gint64 offset;
+  LiviGstFrame *frame;
+  GdkTexture *texture;
+  GstClockTime prev_pts;
 
-  if (self->seek_lock)
+  texture = livi_frame_cache_get_previous (self->step.cache, self->step.pts, &prev_pts, &frame);
+  if (texture) {
+    show_step_frame (self, texture, frame, prev_pts);
     return;
-  self->seek_lock = TRUE;
-
-  offset = g_variant_get_int32 (param) * GST_MSECOND;
-  pos = gst_play_get_position (self->player);
+  }
 
-  if (offset < 0 && labs(offset) > pos)
-    pos = 0;
-  else
-    pos += offset;
+  if (self->step.pts == 0 || !GST_CLOCK_TIME_IS_VALID (self->step.pts))
+    return;
 
-  label = g_strdup_printf (_("%.2lds"), labs(offset / GST_SECOND));
-  move_stream_to_pos (self, pos, label);
+  /*
+   * Decode the whole GOP up to the shown frame once so further steps
+   * back through it come from the cache
+   */
+  self->step.busy = seek_for_step (self, self->step.pts - 1,
+                                   GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE);
+  if (self->step.busy)
+    self->step.fill_target = self->step.pts;
 }
 
 
 static void
-on_seek_activated (GtkWidget *widget, const char *action_name, GVariant *param)
+on_step_activated (GtkWidget *widget, const char *action_name, GVariant *param)
 {
   LiviWindow *self = LIVI_WINDOW (widget);
-  gint64 pos;
 
-  if (self->seek_lock)
+  if (!LIVI_IS_GST_PAINTABLE (self->paintable) || self->player == NULL)
     return;
 
-  self->seek_lock = TRUE;
+  if (self->step.busy) {
+    if (g_get_monotonic_time () - self->step.busy_since < STEP_TIMEOUT_US)
+      return;
 
-  pos = g_variant_get_int32 (param) * GST_MSECOND;
-  move_stream_to_pos (self, pos, NULL);
+    /* E.g. stepping past the end of the stream */
+    g_debug ("Frame step timed out");
+    self->step.busy = FALSE;
+    self->step.fill_target = GST_CLOCK_TIME_NONE;
+    self->step.step_after_seek = FALSE;
+  }
+
+  start_stepping (self);
+
+  if (g_variant_get_int32 (param) > 0)
+    step_forward (self);
+  else
+    step_backward (self);
+
+  if (self->step.busy)
+    self->step.busy_since = g_get_monotonic_time ();
 }
 
 
@@ -675,6 +1964,8 @@ on_player_state_changed (GstPlaySignalAdapter *adapter, GstPlayState state, gpoi
 {
   LiviWindow *self = LIVI_WINDOW (user_data);
   GApplication *app = g_application_get_default ();
+  /* Don't lose the resume position before getting there */
+  GstClockTime position = self->stream.resume_ns;
   const char *icon;
 
   g_assert (LIVI_IS_WINDOW (self));
@@ -682,8 +1973,18 @@ on_player_state_changed (GstPlaySignalAdapter *adapter, GstPlayState state, gpoi
   g_debug ("State %s", gst_play_state_get_name (state));
   self->state = state;
 
+  /* Prerolled, move to where we left off */
+  if ((state == GST_PLAY_STATE_PAUSED || state == GST_PLAY_STATE_PLAYING) &&
+      GST_CLOCK_TIME_IS_VALID (self->stream.resume_ns)) {
+    g_debug ("Resuming at %" GST_TIME_FORMAT, GST_TIME_ARGS (self->stream.resume_ns));
+    player_seek (self, self->stream.resume_ns);
+    self->stream.resume_ns = GST_CLOCK_TIME_NONE;
+  }
+
   if (state == GST_PLAY_STATE_PLAYING) {
     icon = "media-playback-pause-symbolic";
+    stop_stepping (self);
+    resume_subtitle (self);
     self->cookie = gtk_application_inhibit (GTK_APPLICATION (app),
                                             GTK_WINDOW (self),
                                             GTK_APPLICATION_INHIBIT_SUSPEND | GTK_APPLICATION_INHIBIT_IDLE,
@@ -701,6 +2002,7 @@ on_player_state_changed (GstPlaySignalAdapter *adapter, GstPlayState state, gpoi
     }
   } else {
     icon = "media-playback-start-symbolic";
+    pause_subtitle (self);
     if (self->cookie) {
       gtk_application_uninhibit (GTK_APPLICATION (app), self->cookie);
       self->cookie = 0;
@@ -725,10 +2027,12 @@ on_player_state_changed (GstPlaySignalAdapter *adapter, GstPlayState state, gpoi
   }
 
   livi_controls_set_play_icon (self->controls, icon);
+  if (!GST_CLOCK_TIME_IS_VALID (position))
+    position = gst_play_get_position (self->player);
   livi_recent_videos_update (self->recent_videos,
                              self->stream.ref_uri,
                              self->stream.uri_preprocessed,
-                             gst_play_get_position (self->player));
+                             position);
 
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_STATE]);
 }
@@ -774,10 +2078,11 @@ on_player_position_updated (GstPlaySignalAdapter *adapter, guint64 position, gpo
 {
   LiviWindow *self = LIVI_WINDOW (user_data);
 
-  self->seek_lock = FALSE;
-
   g_assert (LIVI_IS_WINDOW (self));
-  livi_controls_set_position (self->controls, position);
+
+  /* Don't move the slider back while scrubbing */
+  if (!self->seek.active)
+    livi_controls_set_position (self->controls, position);
 
   if (self->stream.position_ns == position)
     return;
@@ -945,6 +2250,22 @@ update_title (LiviWindow *self, GstPlayMediaInfo *info)
 }
 
 
+static void
+set_spectrum_enabled (LiviWindow *self, gboolean enabled)
+{
+  gtk_widget_set_visible (GTK_WIDGET (self->spectrum), enabled);
+  if (!enabled)
+    livi_spectrum_clear (self->spectrum);
+
+  /* Don't wake up the main loop for streams that have video */
+  if (self->spectrum_filter) {
+    g_object_set (self->spectrum_filter,
+                  "post-messages", enabled && !gtk_window_is_suspended (GTK_WINDOW (self)),
+                  NULL);
+  }
+}
+
+
 static void
 update_video_streams (LiviWindow *self, GstPlayMediaInfo *info)
 {
@@ -956,9 +2277,19 @@ update_video_streams (LiviWindow *self, GstPlayMediaInfo *info)
   self->num_video_streams = gst_play_media_info_get_number_of_video_streams (info);
   if (self->num_video_streams) {
     gst_play_set_visualization_enabled (self->player, FALSE);
+    set_spectrum_enabled (self, FALSE);
+    return;
+  }
+
+  audio_vis = g_settings_get_string (self->settings, "audio-visualization");
+  if (self->spectrum_filter && g_strcmp0 (audio_vis, "builtin") == 0) {
+    g_debug ("Using builtin visualization");
+    gst_play_set_visualization_enabled (self->player, FALSE);
+    set_spectrum_enabled (self, TRUE);
     return;
   }
 
+  set_spectrum_enabled (self, FALSE);
   vis = gst_play_visualizations_get ();
 
   if (!vis[0]) {
@@ -966,7 +2297,6 @@ update_video_streams (LiviWindow *self, GstPlayMediaInfo *info)
     goto out;
   }
 
-  audio_vis = g_settings_get_string (self->settings, "audio-visualization");
   for (int i = 0; vis[i]; i++) {
     if (g_strcmp0 (vis[i]->name, audio_vis) == 0) {
       visname = audio_vis;
@@ -992,6 +2322,28 @@ update_video_streams (LiviWindow *self, GstPlayMediaInfo *info)
 }
 
 
+/* Rotate while drawing instead of flipping frames upstream */
+static void
+update_orientation (LiviWindow *self, GstPlayMediaInfo *info)
+{
+  GstVideoOrientationMethod method = GST_VIDEO_ORIENTATION_IDENTITY;
+  GList *streams;
+
+  if (!LIVI_IS_GST_PAINTABLE (self->paintable))
+    return;
+
+  streams = gst_play_media_info_get_video_streams (info);
+  if (streams) {
+    GstTagList *tags = gst_play_stream_info_get_tags (GST_PLAY_STREAM_INFO (streams->data));
+
+    if (tags == NULL || !gst_video_orientation_from_tag (tags, &method))
+      method = GST_VIDEO_ORIENTATION_IDENTITY;
+  }
+
+  livi_gst_paintable_set_orientation (LIVI_GST_PAINTABLE (self->paintable), method);
+}
+
+
 static void
 on_media_info_updated (GstPlaySignalAdapter *adapter, GstPlayMediaInfo *info, gpointer user_data)
 {
@@ -1002,6 +2354,7 @@ on_media_info_updated (GstPlaySignalAdapter *adapter, GstPlayMediaInfo *info, gp
 
   update_audio_streams (self, info);
   update_video_streams (self, info);
+  update_orientation (self, info);
   update_title (self, info);
 
   livi_controls_show_mute_button (self->controls, !!show);
@@ -1015,10 +2368,107 @@ on_end_of_stream (GstPlaySignalAdapter *adapter, gpointer user_data)
 
   g_debug ("End of stream");
 
+  if (self->stream.trick_rate < 0) {
+    /* Rewound to the start, continue from there */
+    self->stream.trick_rate = 0;
+    gtk_revealer_set_reveal_child (self->revealer_center, FALSE);
+    self->seek_target_state = STREAM_TARGET_STATE_PLAY;
+    player_seek (self, 0);
+    return;
+  }
+  self->stream.trick_rate = 0;
+
   show_resume_or_restart_overlay (self, FALSE);
 }
 
 
+static void
+setup_player (LiviWindow *self)
+{
+  GstPlayVideoRenderer *video_renderer;
+  g_autofree char *audio_vis = NULL;
+  g_autoptr (GstElement) pipeline = NULL;
+  g_autoptr (GstBus) bus = NULL;
+  GstStructure *config;
+
+  if (self->gtk4paintablesink) {
+    GstElement *video_sink;
+    GdkGLContext *gl_context;
+
+    g_object_get (self->paintable, "gl-context", &gl_context, NULL);
+    if (gl_context) {
+      video_sink = gst_element_factory_make ("glsinkbin", NULL);
+      g_object_set (video_sink, "sink", self->gtk4paintablesink, NULL);
+    } else {
+      video_sink = self->gtk4paintablesink;
+    }
+
+    video_renderer = gst_play_video_overlay_video_renderer_new_with_sink (NULL, video_sink);
+  } else {
+    video_renderer = GST_PLAY_VIDEO_RENDERER (g_object_ref (self->paintable));
+  }
+
+  self->player = gst_play_new (video_renderer);
+  self->signal_adapter = gst_play_signal_adapter_new (self->player);
+  g_object_connect (self->signal_adapter,
+                    "signal::error", G_CALLBACK (on_player_error), self,
+                    "signal::warning", G_CALLBACK (on_player_warning), self,
+                    "signal::buffering", G_CALLBACK (on_player_buffering), self,
+                    "signal::state-changed", G_CALLBACK (on_player_state_changed), self,
+                    "signal::mute-changed", G_CALLBACK (on_player_mute_changed), self,
+                    "signal::duration-changed", G_CALLBACK (on_player_duration_changed), self,
+                    "signal::position-updated", G_CALLBACK (on_player_position_updated), self,
+                    "signal::media-info-updated", G_CALLBACK (on_media_info_updated), self,
+                    "signal::end-of-stream", G_CALLBACK (on_end_of_stream), self,
+                    NULL);
+
+  if (g_settings_get_boolean (self->settings, "native-subtitles"))
+    setup_subtitle_sink (self);
+
+  audio_vis = g_settings_get_string (self->settings, "audio-visualization");
+  if (g_strcmp0 (audio_vis, "builtin") == 0)
+    setup_spectrum_filter (self);
+
+  pipeline = gst_play_get_pipeline (self->player);
+  bus = gst_element_get_bus (pipeline);
+  g_signal_connect_object (bus, "message::async-done", G_CALLBACK (on_async_done), self, 0);
+
+  config = gst_play_get_config (self->player);
+  /* Update position once a second (default is 100ms) */
+  gst_play_config_set_position_update_interval (config, 1000);
+  gst_play_set_config (self->player, config);
+
+  if (self->pending_uri) {
+    g_autofree char *uri = g_steal_pointer (&self->pending_uri);
+
+    gst_play_set_uri (self->player, uri);
+  }
+
+  if (self->pending_play) {
+    self->pending_play = FALSE;
+    livi_window_set_play (self);
+  }
+}
+
+
+static void
+on_paintable_prepared (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  LiviWindow *self;
+  g_autoptr (GError) err = NULL;
+
+  if (!livi_gst_paintable_prepare_finish (LIVI_GST_PAINTABLE (source_object), res, &err)) {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return;
+    g_warning ("Failed to prepare video sink: %s", err->message);
+  }
+
+  self = LIVI_WINDOW (user_data);
+  g_clear_object (&self->player_cancel);
+  setup_player (self);
+}
+
+
 static void
 on_realize (LiviWindow *self)
 {
@@ -1042,46 +2492,20 @@ on_realize (LiviWindow *self)
     livi_gst_paintable_realize (LIVI_GST_PAINTABLE (self->paintable), surface);
   }
 
-  if (!self->player) {
-    GstPlayVideoRenderer *video_renderer;
-    GstStructure *config;
-
-    if (self->gtk4paintablesink) {
-      GstElement *video_sink;
-      GdkGLContext *gl_context;
-
-      g_object_get (self->paintable, "gl-context", &gl_context, NULL);
-      if (gl_context) {
-        video_sink = gst_element_factory_make ("glsinkbin", NULL);
-        g_object_set (video_sink, "sink", self->gtk4paintablesink, NULL);
-      } else {
-        video_sink = self->gtk4paintablesink;
-      }
-
-      video_renderer = gst_play_video_overlay_video_renderer_new_with_sink (NULL, video_sink);
-    } else {
-      video_renderer = GST_PLAY_VIDEO_RENDERER (g_object_ref (self->paintable));
-    }
-
-    self->player = gst_play_new (video_renderer);
-    self->signal_adapter = gst_play_signal_adapter_new (self->player);
-    g_object_connect (self->signal_adapter,
-                      "signal::error", G_CALLBACK (on_player_error), self,
-                      "signal::warning", G_CALLBACK (on_player_warning), self,
-                      "signal::buffering", G_CALLBACK (on_player_buffering), self,
-                      "signal::state-changed", G_CALLBACK (on_player_state_changed), self,
-                      "signal::mute-changed", G_CALLBACK (on_player_mute_changed), self,
-                      "signal::duration-changed", G_CALLBACK (on_player_duration_changed), self,
-                      "signal::position-updated", G_CALLBACK (on_player_position_updated), self,
-                      "signal::media-info-updated", G_CALLBACK (on_media_info_updated), self,
-                      "signal::end-of-stream", G_CALLBACK (on_end_of_stream), self,
-                      NULL);
+  if (self->player || self->player_cancel)
+    return;
 
-    config = gst_play_get_config (self->player);
-    /* Update position once a second (default is 100ms) */
-    gst_play_config_set_position_update_interval (config, 1000);
-    gst_play_set_config (self->player, config);
+  /* Don't hold up mapping the window while the sink sets up GL */
+  if (LIVI_IS_GST_PAINTABLE (self->paintable)) {
+    self->player_cancel = g_cancellable_new ();
+    livi_gst_paintable_prepare_async (LIVI_GST_PAINTABLE (self->paintable),
+                                      self->player_cancel,
+                                      on_paintable_prepared,
+                                      self);
+    return;
   }
+
+  setup_player (self);
 }
 
 
@@ -1089,7 +2513,7 @@ static gboolean
 livi_window_close_request (GtkWindow *window)
 {
   LiviWindow *self = LIVI_WINDOW (window);
-  GstClockTime pos = gst_play_get_position (self->player);
+  GstClockTime pos = self->player ? gst_play_get_position (self->player) : 0;
 
   /* Only update pos > 0 so we don't lose the current pos if
    * e.g. resuming fails due to a network error */
@@ -1110,10 +2534,17 @@ livi_window_dispose (GObject *obj)
   LiviWindow *self = LIVI_WINDOW (obj);
 
   g_clear_pointer (&self->last_local_uri, g_free);
+  g_cancellable_cancel (self->player_cancel);
+  g_clear_object (&self->player_cancel);
+  g_clear_pointer (&self->pending_uri, g_free);
+  g_clear_handle_id (&self->subtitle_hide_id, g_source_remove);
+  g_clear_handle_id (&self->seek.settle_id, g_source_remove);
   g_clear_object (&self->recent_videos);
   g_clear_object (&self->signal_adapter);
   g_clear_object (&self->gtk4paintablesink);
   g_clear_object (&self->player);
+  g_clear_object (&self->spectrum_filter);
+  g_clear_object (&self->step.cache);
   if (self->cookie) {
     GApplication *app = g_application_get_default ();
 
@@ -1152,6 +2583,12 @@ livi_window_class_init (LiviWindowClass *klass)
                       10, G_MAXINT, 100,
                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
 
+  /* Whether the last playback speed change avoided a flushing seek */
+  props[PROP_INSTANT_RATE] =
+    g_param_spec_boolean ("instant-rate", "", "",
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
   props[PROP_STATE] =
     g_param_spec_enum ("state", "", "",
                        GST_TYPE_PLAY_STATE,
@@ -1176,6 +2613,7 @@ livi_window_class_init (LiviWindowClass *klass)
   g_object_class_install_properties (object_class, LAST_PROP, props);
 
   g_type_ensure (LIVI_TYPE_CONTROLS);
+  g_type_ensure (LIVI_TYPE_SPECTRUM);
 
   gtk_widget_class_set_template_from_resource (widget_class, "/org/sigxcpu/Livi/livi-window.ui");
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, box_content);
@@ -1191,9 +2629,11 @@ livi_window_class_init (LiviWindowClass *klass)
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, img_center);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, lbl_center);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, lbl_status);
+  gtk_widget_class_bind_template_child (widget_class, LiviWindow, lbl_subtitle);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, overlay);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, picture_video);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, revealer_center);
+  gtk_widget_class_bind_template_child (widget_class, LiviWindow, spectrum);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, stack_center);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, stack_content);
   gtk_widget_class_bind_template_child (widget_class, LiviWindow, toolbar);
@@ -1211,9 +2651,12 @@ livi_window_class_init (LiviWindowClass *klass)
                                    on_toggle_controls_activated);
   gtk_widget_class_install_action (widget_class, "win.ff", "i", on_ff_rev_activated);
   gtk_widget_class_install_action (widget_class, "win.seek", "i", on_seek_activated);
+  gtk_widget_class_install_action (widget_class, "win.trick-mode", "i", on_trick_mode_activated);
+  gtk_widget_class_install_action (widget_class, "win.step", "i", on_step_activated);
   gtk_widget_class_install_action (widget_class, "win.toggle-play", NULL, on_toggle_play_activated);
   gtk_widget_class_install_action (widget_class, "win.open-file", NULL, on_open_file_activated);
   gtk_widget_class_install_action (widget_class, "win.restart", NULL, on_restart_activated);
+  gtk_widget_class_install_action (widget_class, "win.snapshot", NULL, on_snapshot_activated);
 
   provider = gtk_css_provider_new ();
   gtk_css_provider_load_from_resource (provider, "/org/sigxcpu/Livi/style.css");
@@ -1250,6 +2693,7 @@ livi_window_init (LiviWindow *self)
   const char *force_builtin_sink = g_getenv ("LIVI_FORCE_BUILTIN_SINK");
 
   self->settings = g_settings_new ("org.sigxcpu.Livi");
+  self->step.cache = livi_frame_cache_new (FRAME_CACHE_FRAMES, FRAME_CACHE_BYTES);
 
   reset_stream (self);
 
@@ -1265,12 +2709,20 @@ livi_window_init (LiviWindow *self)
   } else {
     self->paintable = livi_gst_paintable_new ();
     gtk_picture_set_paintable (self->picture_video, self->paintable);
+    g_signal_connect_object (self->paintable, "notify::offloadable",
+                             G_CALLBACK (on_offloadable_changed), self, G_CONNECT_SWAPPED);
+    g_signal_connect_object (self->paintable, "frame-presented",
+                             G_CALLBACK (on_frame_presented), self, G_CONNECT_SWAPPED);
+    g_settings_bind (self->settings, "downscale-video", self->paintable, "downscale",
+                     G_SETTINGS_BIND_GET);
 
     g_debug ("Using built in sink");
   }
 
   add_controls_toggle (self, GTK_WIDGET (self->picture_video));
   add_controls_toggle (self, GTK_WIDGET (self->revealer_center));
+  add_zoom_and_pan (self, GTK_WIDGET (self->picture_video));
+  reset_zoom (self);
 
   arm_hide_controls_timer (self);
 
@@ -1296,10 +2748,16 @@ livi_window_resume_pos (LiviWindow *self)
   pos = livi_recent_videos_get_pos (self->recent_videos, self->stream.ref_uri);
   if (pos > 0) {
     pos *= GST_MSECOND;
-    /* Seek directly without showing any overlays */
     g_debug ("Found video %s, resuming at %" G_GINT64_FORMAT "s", self->stream.ref_uri, pos / GST_SECOND);
-    gst_play_seek (self->player, pos);
+    /*
+     * Seek once prerolled, see on_player_state_changed (). GstPlay has
+     * no way to start at a given position so the stream still prerolls
+     * from 0 first.
+     */
+    self->stream.resume_ns = pos;
     show_resume_or_restart_overlay (self, TRUE);
+    /* No need to start playback for a preview as we only preroll */
+    self->seek_target_state = STREAM_TARGET_STATE_NONE;
   }
 }
 
@@ -1310,9 +2768,22 @@ livi_window_set_uris (LiviWindow *self, const char *uri, const char *ref_uri)
   g_assert (LIVI_IS_WINDOW (self));
 
   reset_stream (self);
+  reset_seek (self);
+  reset_zoom (self);
+  self->step.active = FALSE;
+  self->step.busy = FALSE;
+  livi_frame_cache_clear (self->step.cache);
+  if (LIVI_IS_GST_PAINTABLE (self->paintable))
+    livi_gst_paintable_set_held_frames (LIVI_GST_PAINTABLE (self->paintable), 0);
   gtk_stack_set_visible_child (self->stack_content, GTK_WIDGET (self->box_content));
 
-  gst_play_set_uri (self->player, uri);
+  if (self->player) {
+    gst_play_set_uri (self->player, uri);
+  } else {
+    /* Picked up once the player got created */
+    g_free (self->pending_uri);
+    self->pending_uri = g_strdup (uri);
+  }
 
   if (ref_uri) {
     self->stream.ref_uri = g_strdup (ref_uri);
@@ -1350,6 +2821,21 @@ livi_window_set_play (LiviWindow *self)
 {
   g_assert (LIVI_IS_WINDOW (self));
 
+  if (self->player == NULL) {
+    self->pending_play = TRUE;
+    return;
+  }
+
+  /*
+   * When resuming only preroll so the seek to the resume position
+   * happens before playback starts and only data from there on is
+   * fetched and decoded.
+   */
+  if (GST_CLOCK_TIME_IS_VALID (self->stream.resume_ns)) {
+    gst_play_pause (self->player);
+    return;
+  }
+
   gst_play_play (self->player);
 }
 
@@ -1358,6 +2844,11 @@ livi_window_set_pause (LiviWindow *self)
 {
   g_assert (LIVI_IS_WINDOW (self));
 
+  if (self->player == NULL) {
+    self->pending_play = FALSE;
+    return;
+  }
+
   gst_play_pause (self->player);
 }
 